@@ -35,6 +35,38 @@ typedef enum
 #define MAX_LINE_LENGTH 82
 #define MAX_LABEL_LENGTH 31
 #define MAX_FILENAME_LENGTH 256
+#define MAX_JOBS 256 /* upper bound for -j */
+
+/* Growable in-memory text - the macro-expanded source handed between phases */
+typedef struct
+{
+    char *data;
+    size_t length;
+    size_t capacity;
+} TextBuffer;
+
+/* Command line options */
+typedef struct
+{
+    Boolean keep_am; /* --keep-am: also write the expanded source to <name>.am */
+    const char **files; /* input files in command line order */
+    int file_count;
+    int jobs;           /* -j N: files assembled at the same time */
+    int max_errors;     /* --max-errors N: first pass stops after N errors, 0 = no limit */
+    const char *serve_socket;  /* --serve PATH: run as a daemon on this Unix socket */
+    const char *client_socket; /* --client PATH: let the daemon on PATH assemble the files */
+    const char *cache_dir;     /* --cache-dir DIR: reuse outputs of unchanged sources */
+    int stats;                 /* --stats[=json]: STATS_OFF, STATS_TEXT or STATS_JSON (stats.h) */
+    const char *stats_file;    /* --stats-file FILE: write the --stats report to FILE */
+    const char *macro_lib;       /* --macro-lib FILE: precompiled macros available to every file */
+    const char *build_macro_lib; /* --build-macro-lib OUT: compile the input's mcro blocks to OUT */
+    Boolean read_stdin;          /* - or --stdin: pipe mode, the source is stdin */
+    int ob_fd;                   /* --ob-fd N: pipe mode object output, stdout by default */
+    int ent_fd;                  /* --ent-fd N, --ext-fd N: pipe mode entries and externals, */
+    int ext_fd;                  /*   -1 (not written) by default */
+} AssemblerOptions;
+
+extern AssemblerOptions assembler_options;
 
 /* Error handling */
 void print_error(ErrorType error_type, int line_number, const char *message);
@@ -47,8 +79,13 @@ void print_error(ErrorType error_type, int line_number, const char *message);
 #define ENT_EXTENSION ".ent"
 #define EXT_EXTENSION ".ext"
 
-/* Public API */
-Boolean process_files(int argc, char *argv[]);
-Boolean process_single_file(const char *filename);
+/* Public API; stats is NULL unless --stats asked for it (one FileStats per file) */
+struct FileStats;
+Boolean parse_options(int argc, char *argv[]);
+Boolean is_option(const char *arg);
+Boolean process_files(const char **files, int file_count, struct FileStats *stats);
+Boolean process_single_file(const char *filename, struct FileStats *stats);
+Boolean process_stdin(struct FileStats *stats);
+Boolean build_macro_library(const char *filename, const char *library_path);
 
-#endif /* ASSEMBLER_H */
\ No newline at end of file
+#endif /* ASSEMBLER_H */
\ No newline at end of file
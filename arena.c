@@ -0,0 +1,136 @@
+/* arena.c - per-file bump allocator for assembly state */
+#include "arena.h"
+#include "console.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* regular block size; bigger requests get a block of their own */
+#define ARENA_BLOCK_SIZE 16384
+
+/* every allocation is aligned for the strictest of these types */
+typedef union
+{
+    long l;
+    double d;
+    void *p;
+} ArenaAlign;
+
+#define ARENA_ALIGNMENT sizeof(ArenaAlign)
+#define ARENA_ROUND(n) (((n) + ARENA_ALIGNMENT - 1) / ARENA_ALIGNMENT * ARENA_ALIGNMENT)
+
+/* block header size, rounded so that the data after it stays aligned */
+#define ARENA_HEADER_SIZE ARENA_ROUND(sizeof(ArenaBlock))
+
+void arena_init(Arena *arena)
+{
+    arena->blocks = NULL;
+    arena->used = 0;
+    arena->reserved = 0;
+    arena->allocations = 0;
+    arena->block_count = 0;
+    arena->high_water = 0;
+}
+
+/**
+ * @brief Allocate size bytes that live until the arena is released
+ * @return Aligned memory, or NULL if a new block cannot be allocated
+ */
+void *arena_alloc(Arena *arena, size_t size)
+{
+    ArenaBlock *block = arena->blocks;
+    void *result;
+
+    size = ARENA_ROUND(size ? size : 1);
+
+    if (!block || block->size - block->used < size)
+    {
+        size_t block_size = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+
+        block = malloc(ARENA_HEADER_SIZE + block_size);
+        if (!block)
+            return NULL;
+
+        block->size = block_size;
+        block->used = 0;
+        block->next = arena->blocks;
+        arena->blocks = block;
+        arena->block_count++;
+        arena->reserved += block_size;
+        if (arena->reserved > arena->high_water)
+            arena->high_water = arena->reserved;
+    }
+
+    result = (char *)block + ARENA_HEADER_SIZE + block->used;
+    block->used += size;
+    arena->used += size;
+    arena->allocations++;
+    return result;
+}
+
+/* copy a string into the arena */
+char *arena_strdup(Arena *arena, const char *str)
+{
+    size_t length = strlen(str) + 1;
+    char *copy = arena_alloc(arena, length);
+
+    if (copy)
+        memcpy(copy, str, length);
+    return copy;
+}
+
+/* free every block at once; the high-water mark survives */
+void arena_release(Arena *arena)
+{
+    ArenaBlock *block = arena->blocks;
+
+    while (block)
+    {
+        ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+
+    arena->blocks = NULL;
+    arena->used = 0;
+    arena->reserved = 0;
+    arena->allocations = 0;
+    arena->block_count = 0;
+}
+
+/* forget every allocation but keep one regular block for the next file */
+void arena_reset(Arena *arena)
+{
+    ArenaBlock *keep = NULL;
+    ArenaBlock *block = arena->blocks;
+
+    while (block)
+    {
+        ArenaBlock *next = block->next;
+        if (!keep && block->size == ARENA_BLOCK_SIZE)
+            keep = block;
+        else
+            free(block);
+        block = next;
+    }
+
+    arena->blocks = keep;
+    arena->used = 0;
+    arena->reserved = 0;
+    arena->allocations = 0;
+    arena->block_count = 0;
+    if (keep)
+    {
+        keep->next = NULL;
+        keep->used = 0;
+        arena->reserved = keep->size;
+        arena->block_count = 1;
+    }
+}
+
+void print_arena_stats(const Arena *arena)
+{
+    log_verbose(("Arena: %lu bytes in %ld allocations, %d blocks (%lu bytes), high-water %lu bytes\n",
+           (unsigned long)arena->used, arena->allocations, arena->block_count,
+           (unsigned long)arena->reserved, (unsigned long)arena->high_water));
+}
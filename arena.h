@@ -0,0 +1,32 @@
+/* arena.h - per-file bump allocator for assembly state */
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/* one chunk of arena memory; the usable bytes follow the header */
+typedef struct ArenaBlock
+{
+    struct ArenaBlock *next;
+    size_t size;
+    size_t used;
+} ArenaBlock;
+
+typedef struct
+{
+    ArenaBlock *blocks; /* newest first */
+    size_t used;        /* bytes handed out since the last release */
+    size_t reserved;    /* bytes held in blocks since the last release */
+    long allocations;   /* allocations since the last release */
+    int block_count;    /* blocks since the last release */
+    size_t high_water;  /* largest 'reserved' seen, kept across releases */
+} Arena;
+
+void arena_init(Arena *arena);
+void *arena_alloc(Arena *arena, size_t size);
+char *arena_strdup(Arena *arena, const char *str);
+void arena_release(Arena *arena);
+void arena_reset(Arena *arena);
+void print_arena_stats(const Arena *arena);
+
+#endif /* ARENA_H */
@@ -0,0 +1,319 @@
+/**
+ * @file asm.c
+ * @brief Library entry points - runs every phase on a source held in memory
+ *
+ * The pipeline that used to live in the command line driver:
+ * 1. Pre-assembler (macro expansion)
+ * 2. First pass (symbol table building)
+ * 3. Memory image building
+ * 4. Second pass (code generation)
+ * 5. Output formatting (.ob/.ent/.ext contents, in memory)
+ *
+ * Nothing here touches the file system; assembler.c reads the .as file,
+ * calls asm_assemble_source and writes the returned texts.
+ */
+
+#include "asm.h"
+#include "preassembler.h"
+#include "first_pass.h"
+#include "second_pass.h"
+#include "memory_builder.h"
+#include "output_writer.h"
+#include "line_parser.h"
+#include "text_buffer.h"
+#include "context.h"
+#include "console.h"
+#include "stats.h"
+
+/* name used in messages by asm_assemble_buffer */
+#define BUFFER_SOURCE_NAME "<buffer>"
+
+/* Hand the contents of a text buffer over to a result text */
+static void take_text(AsmText *text, TextBuffer *buffer)
+{
+    text->data = buffer->data;
+    text->length = buffer->length;
+    init_text_buffer(buffer);
+}
+
+/* Format one output file into a result text; FALSE when out of memory */
+static Boolean format_text(AsmText *text, const AssemblerContext *ctx,
+                           Boolean (*format)(const AssemblerContext *, TextBuffer *))
+{
+    TextBuffer buffer;
+
+    init_text_buffer(&buffer);
+    if (!format(ctx, &buffer) || !append_to_text_buffer(&buffer, "", 0))
+    {
+        free_text_buffer(&buffer);
+        return FALSE;
+    }
+    take_text(text, &buffer);
+    return TRUE;
+}
+
+/* Copy the memory image and the reference lists of a finished assembly */
+static Boolean fill_result(const AssemblerContext *ctx, AsmResult *out)
+{
+    const MemoryImage *memory = &ctx->memory;
+    const EntryPoint *entry;
+    const ExtRef *ext;
+    int i;
+
+    out->instruction_count = memory->instruction_count;
+    out->data_count = memory->data_count;
+    out->word_count = memory->instruction_count + memory->data_count;
+    out->entry_count = count_entries(ctx->entry_list);
+    out->external_count = count_externals(ctx->ext_list);
+
+    out->words = malloc((out->word_count ? out->word_count : 1) * sizeof(AsmWord));
+    out->entries = malloc((out->entry_count ? out->entry_count : 1) * sizeof(AsmSymbol));
+    out->externals = malloc((out->external_count ? out->external_count : 1) * sizeof(AsmSymbol));
+    if (!out->words || !out->entries || !out->externals)
+        return FALSE;
+
+    for (i = 0; i < memory->instruction_count; i++)
+    {
+        out->words[i].address = BASE_ADDRESS + i;
+        out->words[i].value = memory->instruction_image[i].bits;
+    }
+    for (i = 0; i < memory->data_count; i++)
+    {
+        out->words[memory->instruction_count + i].address = BASE_ADDRESS + memory->instruction_count + i;
+        out->words[memory->instruction_count + i].value = memory->data_image[i].bits;
+    }
+
+    for (entry = ctx->entry_list, i = 0; entry; entry = entry->next, i++)
+    {
+        strcpy(out->entries[i].name, entry->symbol_name);
+        out->entries[i].address = entry->address;
+    }
+    for (ext = ctx->ext_list, i = 0; ext; ext = ext->next, i++)
+    {
+        strcpy(out->externals[i].name, ext->symbol_name);
+        out->externals[i].address = ext->address;
+    }
+
+    if (!format_text(&out->ob_text, ctx, format_object_file))
+        return FALSE;
+    if (out->entry_count > 0 && !format_text(&out->ent_text, ctx, format_entries_file))
+        return FALSE;
+    if (out->external_count > 0 && !format_text(&out->ext_text, ctx, format_externals_file))
+        return FALSE;
+    return TRUE;
+}
+
+/* --macro-lib: macros every assembly can call; read-only, shared by all threads */
+static const AsmMacroLibrary *shared_macro_library = NULL;
+
+void asm_use_macro_library(const AsmMacroLibrary *library)
+{
+    shared_macro_library = library;
+}
+
+/* warm state kept between the assemblies of a session */
+struct AsmSession
+{
+    AssemblerContext context;
+};
+
+/* Drop the per-file state, after copying its counters into the result;
+   the symbol index and one arena block stay allocated */
+static void release_file_state(AssemblerContext *context, AsmResult *out)
+{
+    out->stats.lines_read = context->lines_read;
+    out->stats.macros_expanded = context->macros_expanded;
+    out->stats.symbol_lookups = context->symbols.lookups;
+    out->stats.symbol_probes = context->symbols.probes;
+    out->stats.fixups = context->memory.fixup_count;
+    out->stats.allocations = context->arena.allocations;
+
+    print_arena_stats(&context->arena);
+    reset_assembler_context(context);
+}
+
+/* Run every phase on one source file, in an empty context */
+static int assemble(AssemblerContext *ctx, const char *name, const char *src, size_t len,
+                    int max_errors, AsmResult *out)
+{
+    Boolean success;
+    TextBuffer source; /* read-only view of src, never freed */
+    TextBuffer expanded;
+    ParsedProgram program;
+    PhaseClock clock;
+
+    memset(out, 0, sizeof(*out));
+
+    source.data = (char *)src;
+    source.length = len;
+    source.capacity = 0;
+
+    ctx->max_errors = max_errors;
+    ctx->macro_library = shared_macro_library;
+
+    log_verbose(("\n=== PHASE 1: PRE-ASSEMBLER ===\n"));
+
+    /* Phase 1: Pre-assembler (macro expansion into memory) */
+    init_text_buffer(&expanded);
+    start_phase_clock(&clock);
+    success = preassembler(ctx, &source, &expanded);
+    stop_phase_clock(&clock, &out->stats, ASM_PHASE_PREASSEMBLER);
+    if (!success)
+    {
+        console_out("Pre-assembler phase failed for file: %s\n", name);
+        out->error_count = ctx->error_count;
+        free_text_buffer(&expanded);
+        release_file_state(ctx, out);
+        return 0;
+    }
+    log_verbose(("Pre-assembler phase completed successfully.\n"));
+
+    /* The expanded source goes to the caller (--keep-am); an empty one
+       still gets a buffer, so data is set exactly when phase 1 succeeded */
+    if (!append_to_text_buffer(&expanded, "", 0))
+    {
+        print_error(MEMORY_ALLOCATION_ERROR, 0, "copying the expanded source");
+        free_text_buffer(&expanded);
+        release_file_state(ctx, out);
+        return 0;
+    }
+    take_text(&out->am_text, &expanded);
+    expanded.data = out->am_text.data;
+    expanded.length = out->am_text.length;
+
+    log_verbose(("\n=== PHASE 2: FIRST PASS ===\n"));
+
+    /* Phase 2: First pass (symbol table building, parses every statement once) */
+    init_parsed_program(&program);
+    start_phase_clock(&clock);
+    success = first_pass(ctx, &expanded, &program);
+    stop_phase_clock(&clock, &out->stats, ASM_PHASE_FIRST_PASS);
+    if (!success)
+    {
+        /* the later phases would only work on a broken program */
+        console_out("First pass failed for file: %s (%d errors)\n", name, ctx->error_count);
+        out->error_count = ctx->error_count;
+        free_parsed_program(&program);
+        release_file_state(ctx, out);
+        return 0;
+    }
+    log_verbose(("First pass completed successfully.\n"));
+
+    log_verbose(("\n=== PHASE 3: MEMORY IMAGE BUILDING ===\n"));
+
+    /* Phase 3: Build memory image */
+    start_phase_clock(&clock);
+    success = build_memory_image(ctx, &program);
+    stop_phase_clock(&clock, &out->stats, ASM_PHASE_MEMORY_IMAGE);
+    if (!success)
+    {
+        console_out("Memory image building failed for file: %s\n", name);
+        out->error_count = ctx->error_count;
+        free_parsed_program(&program);
+        release_file_state(ctx, out);
+        return 0;
+    }
+    log_verbose(("Memory image built successfully.\n"));
+
+    log_verbose(("\n=== PHASE 4: SECOND PASS ===\n"));
+
+    /* Phase 4: Second pass (complete encoding) */
+    start_phase_clock(&clock);
+    success = second_pass(ctx, name, &program);
+    stop_phase_clock(&clock, &out->stats, ASM_PHASE_SECOND_PASS);
+    free_parsed_program(&program);
+    out->error_count = ctx->error_count;
+    if (!success)
+    {
+        console_out("Second pass failed for file: %s\n", name);
+        release_file_state(ctx, out);
+        return 0;
+    }
+    log_verbose(("Second pass completed successfully.\n"));
+
+    /* Phase 5: hand the image and the output file contents to the caller */
+    start_phase_clock(&clock);
+    success = fill_result(ctx, out);
+    stop_phase_clock(&clock, &out->stats, ASM_PHASE_OUTPUT);
+    if (!success)
+    {
+        print_error(MEMORY_ALLOCATION_ERROR, 0, "formatting the output files");
+        release_file_state(ctx, out);
+        return 0;
+    }
+
+    release_file_state(ctx, out);
+    return 1;
+}
+
+/* Run every phase on one source file */
+int asm_assemble_source(const char *name, const char *src, size_t len,
+                        int max_errors, AsmResult *out)
+{
+    AssemblerContext context;
+    int success;
+
+    init_assembler_context(&context);
+    success = assemble(&context, name, src, len, max_errors, out);
+    free_assembler_context(&context);
+    return success;
+}
+
+/* Start a session; NULL when out of memory */
+AsmSession *asm_session_create(void)
+{
+    AsmSession *session = malloc(sizeof(AsmSession));
+
+    if (session)
+        init_assembler_context(&session->context);
+    return session;
+}
+
+/* Assemble like asm_assemble_source, reusing the session's allocations */
+int asm_session_assemble(AsmSession *session, const char *name, const char *src, size_t len,
+                         int max_errors, AsmResult *out)
+{
+    return assemble(&session->context, name, src, len, max_errors, out);
+}
+
+/* End a session */
+void asm_session_free(AsmSession *session)
+{
+    if (!session)
+        return;
+    free_assembler_context(&session->context);
+    free(session);
+}
+
+/* Run every phase, capturing what would be printed into out->diagnostics */
+int asm_assemble_buffer(const char *src, size_t len, AsmResult *out)
+{
+    ConsoleCapture capture;
+    ConsoleCapture *previous = get_console_capture();
+    int success;
+
+    init_console_capture(&capture);
+    set_console_capture(&capture);
+    success = asm_assemble_source(BUFFER_SOURCE_NAME, src, len, 0, out);
+    set_console_capture(previous);
+
+    /* an empty capture still gets a buffer, so diagnostics is always text */
+    append_to_text_buffer(&capture.text, "", 0);
+    take_text(&out->diagnostics, &capture.text);
+    free_console_capture(&capture);
+    return success;
+}
+
+/* Release everything a result holds */
+void asm_free_result(AsmResult *result)
+{
+    free(result->words);
+    free(result->entries);
+    free(result->externals);
+    free(result->diagnostics.data);
+    free(result->am_text.data);
+    free(result->ob_text.data);
+    free(result->ent_text.data);
+    free(result->ext_text.data);
+    memset(result, 0, sizeof(*result));
+}
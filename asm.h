@@ -0,0 +1,132 @@
+/* asm.h - the assembler as a library (libasm.a / libasm.so)
+ *
+ * Assembles one source file held in memory and returns everything the
+ * command line tool would write to disk. This header is self-contained:
+ * programs linking libasm need nothing else from the source tree.
+ */
+#ifndef ASM_H
+#define ASM_H
+
+#include <stddef.h>
+
+/* libasm.so is built with -fvisibility=hidden: only these functions are exported */
+#if defined(__GNUC__) && __GNUC__ >= 4
+#define ASM_API __attribute__((visibility("default")))
+#else
+#define ASM_API
+#endif
+
+#define ASM_VERSION "1.1.0" /* bump when the output for a given source changes */
+#define ASM_SYMBOL_LENGTH 31 /* longest symbol name, including the NUL */
+
+/* NUL terminated text of known length; data is NULL when not produced */
+typedef struct
+{
+    char *data;
+    size_t length;
+} AsmText;
+
+/* one 10-bit word of the memory image */
+typedef struct
+{
+    int address;
+    unsigned int value;
+} AsmWord;
+
+/* an .entry symbol, or one use of an .extern symbol */
+typedef struct
+{
+    char name[ASM_SYMBOL_LENGTH];
+    int address;
+} AsmSymbol;
+
+/* phases of one assembly, in order */
+typedef enum
+{
+    ASM_PHASE_PREASSEMBLER,
+    ASM_PHASE_FIRST_PASS,
+    ASM_PHASE_MEMORY_IMAGE,
+    ASM_PHASE_SECOND_PASS,
+    ASM_PHASE_OUTPUT, /* formatting the .ob/.ent/.ext texts */
+    ASM_PHASE_COUNT
+} AsmPhase;
+
+/* where the time of one assembly went and what it did; always collected */
+typedef struct
+{
+    double wall_seconds[ASM_PHASE_COUNT]; /* 0 for phases that did not run */
+    double cpu_seconds[ASM_PHASE_COUNT];  /* CPU time of the calling thread */
+    long lines_read;      /* source lines read by the pre-assembler */
+    long macros_expanded; /* macro calls replaced by their bodies */
+    long symbol_lookups;  /* symbol table searches */
+    long symbol_probes;   /* index slots visited by those searches */
+    long fixups;          /* symbol operands resolved by the second pass */
+    long allocations;     /* arena allocations */
+} AsmStats;
+
+/* everything one assembly produced; release with asm_free_result */
+typedef struct
+{
+    int error_count;       /* diagnostics reported */
+    int instruction_count; /* IC of the object file header */
+    int data_count;        /* DC of the object file header */
+
+    AsmWord *words; /* instructions, then data, in address order */
+    int word_count;
+    AsmSymbol *entries;
+    int entry_count;
+    AsmSymbol *externals;
+    int external_count;
+
+    AsmText diagnostics; /* everything the assembly printed (asm_assemble_buffer only) */
+    AsmText am_text;     /* macro-expanded source, if the pre-assembler succeeded */
+    AsmText ob_text;     /* contents of the .ob file, on success */
+    AsmText ent_text;    /* contents of the .ent file, if there are entries */
+    AsmText ext_text;    /* contents of the .ext file, if there are externals */
+
+    AsmStats stats; /* per-phase time and counters, also for a failed assembly */
+} AsmResult;
+
+/* Assemble len bytes of source. Returns 1 if the program assembled
+   without errors, 0 otherwise; out is filled in either case and the
+   diagnostics are captured into out->diagnostics instead of printed. */
+ASM_API int asm_assemble_buffer(const char *src, size_t len, AsmResult *out);
+
+/* Same, but diagnostics go to stdout/stderr as the command line tool
+   prints them, naming the file name. max_errors stops the first pass
+   after that many errors (0 = no limit). */
+ASM_API int asm_assemble_source(const char *name, const char *src, size_t len,
+                                int max_errors, AsmResult *out);
+
+/* A session keeps the allocator blocks and the symbol index warm between
+   assemblies (used by assembler --serve). Not shared between threads. */
+typedef struct AsmSession AsmSession;
+
+ASM_API AsmSession *asm_session_create(void);
+ASM_API int asm_session_assemble(AsmSession *session, const char *name, const char *src, size_t len,
+                                 int max_errors, AsmResult *out);
+ASM_API void asm_session_free(AsmSession *session);
+
+/* Release everything a result holds */
+ASM_API void asm_free_result(AsmResult *result);
+
+/* A precompiled macro library (.mlib), built from a file of mcro blocks.
+   It is mapped read-only, so any number of assemblies and threads can
+   share it. */
+typedef struct AsmMacroLibrary AsmMacroLibrary;
+
+/* Build a library at path from len bytes of source holding only mcro
+   blocks (name is used in messages). Returns 1 on success; diagnostics
+   are printed. */
+ASM_API int asm_macro_library_build(const char *name, const char *src, size_t len, const char *path);
+
+/* Map a library; NULL, with a message, if it cannot be read or is not
+   a macro library */
+ASM_API AsmMacroLibrary *asm_macro_library_open(const char *path);
+ASM_API void asm_macro_library_close(AsmMacroLibrary *library);
+
+/* Let every later assembly call the macros of library (NULL: none), as
+   if they were defined before its source. Set it before assembling. */
+ASM_API void asm_use_macro_library(const AsmMacroLibrary *library);
+
+#endif /* ASM_H */
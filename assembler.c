@@ -1,23 +1,63 @@
 /**
  * @file assembler.c
- * @brief Main assembler program - coordinates all assembly phases
+ * @brief Main assembler program - the command line front end of libasm
  * 
- * This is the main entry point for the two-pass assembler. It processes
- * assembly source files through multiple phases:
- * 1. Pre-assembler (macro expansion)
- * 2. First pass (symbol table building)
- * 3. Memory image building
- * 4. Second pass (code generation)
- * 5. Output file generation
+ * This is the main entry point for the two-pass assembler. It reads the
+ * options, then for every input file reads the .as source, assembles it
+ * in memory with asm_assemble_source (pre-assembler, first pass, memory
+ * image, second pass - see asm.c) and writes the .ob/.ent/.ext files.
  */
 
+/* for the pthread declarations under -ansi */
+#define _POSIX_C_SOURCE 200112L
+
+#include "asm.h"
+#include "serve.h"
+#include "cache.h"
+#include "stats.h"
 #include "preassembler.h"
-#include "first_pass.h"
-#include "second_pass.h"
-#include "memory_builder.h"
-#include "output_writer.h"
+#include "text_buffer.h"
+#include "arena.h"
 #include "assembler.h"
 #include "types.h"
+#include "console.h"
+#include <pthread.h>
+#include <limits.h>
+#include <unistd.h>
+
+/* Options given on the command line, shared by all phases */
+AssemblerOptions assembler_options = {FALSE, NULL, 0, 1, 0, NULL, NULL, NULL, STATS_OFF, NULL, NULL, NULL,
+                                      FALSE, 1, -1, -1};
+
+#define USAGE "Usage: %s [--keep-am] [-j N] [--max-errors N] [-q | -v | -vv] [--client SOCKET]\n" \
+              "       [--cache-dir DIR] [--stats[=json]] [--stats-file FILE] [--macro-lib FILE]\n" \
+              "       <file1> [file2] ...\n" \
+              "       %s [-q | -v] [--macro-lib FILE] --serve SOCKET\n" \
+              "       %s [-q | -v] --build-macro-lib OUT <file>\n" \
+              "       %s [options] [--ob-fd N] [--ent-fd N] [--ext-fd N] - (or --stdin)\n"
+
+/* the input in pipe mode, in messages and --stats */
+#define STDIN_NAME "stdin"
+
+/* one input file of a parallel run */
+typedef struct
+{
+    const char *filename;
+    FileStats *stats;      /* NULL without --stats */
+    ConsoleCapture output; /* everything printed while assembling the file */
+    Boolean success;
+    Boolean done;
+} FileJob;
+
+/* files handed out to the worker threads in input order */
+typedef struct
+{
+    FileJob *jobs;
+    int count;
+    int next; /* next file to hand out */
+    pthread_mutex_t lock;
+    pthread_cond_t finished; /* signalled whenever a file is done */
+} JobQueue;
 
 /**
  * @brief Main function - entry point of the assembler
@@ -28,148 +68,822 @@
 int main(int argc, char *argv[])
 {
     Boolean success = TRUE;
+    FileStats *stats = NULL;
+    FILE *stats_stream = NULL;
+    AsmMacroLibrary *macro_library = NULL;
+    int status;
+
+    if (!parse_options(argc, argv))
+    {
+        console_out(USAGE, argv[0], argv[0], argv[0], argv[0]);
+        free(assembler_options.files);
+        return 1;
+    }
+
+    /* Pipe mode: stdin is the only input; stdout may carry the object,
+       so everything else that would be printed there goes to stderr */
+    if (assembler_options.read_stdin)
+    {
+        redirect_console_stdout(stderr);
+        if (assembler_options.file_count > 0 || assembler_options.keep_am ||
+            assembler_options.serve_socket || assembler_options.build_macro_lib)
+        {
+            console_out("Error: - (--stdin) cannot be combined with input files, --keep-am, "
+                        "--serve or --build-macro-lib\n");
+            free(assembler_options.files);
+            return 1;
+        }
+        assembler_options.files[assembler_options.file_count++] = STDIN_NAME;
+    }
+
+    /* Tool mode: compile the mcro blocks of one file into a library */
+    if (assembler_options.build_macro_lib)
+    {
+        if (assembler_options.file_count != 1 || assembler_options.macro_lib)
+        {
+            console_out("Error: --build-macro-lib takes exactly one input file\n");
+            console_out(USAGE, argv[0], argv[0], argv[0], argv[0]);
+            free(assembler_options.files);
+            return 1;
+        }
+        success = build_macro_library(assembler_options.files[0], assembler_options.build_macro_lib);
+        free(assembler_options.files);
+        return success ? 0 : 1;
+    }
+
+    /* The library is mapped once and shared by all files; the daemon and
+       the cache know nothing of it, so it cannot be combined with them */
+    if (assembler_options.macro_lib)
+    {
+        if (assembler_options.client_socket || assembler_options.cache_dir)
+        {
+            console_out("Error: --macro-lib cannot be used with --client or --cache-dir\n");
+            free(assembler_options.files);
+            return 1;
+        }
+        macro_library = asm_macro_library_open(assembler_options.macro_lib);
+        if (!macro_library)
+        {
+            free(assembler_options.files);
+            return 1;
+        }
+        asm_use_macro_library(macro_library);
+    }
+
+    /* Daemon mode: files come over the socket */
+    if (assembler_options.serve_socket)
+    {
+        free(assembler_options.files);
+        if (assembler_options.file_count > 0 || assembler_options.client_socket)
+        {
+            console_out("Error: --serve takes no input files\n");
+            console_out(USAGE, argv[0], argv[0], argv[0], argv[0]);
+            asm_macro_library_close(macro_library);
+            return 1;
+        }
+        status = serve(assembler_options.serve_socket);
+        asm_macro_library_close(macro_library);
+        return status;
+    }
 
     /* Check if any input files were provided */
-    if (argc < 2)
+    if (assembler_options.file_count == 0)
     {
-        printf("Warning: No input files provided.\n");
-        printf("Usage: %s <file1> [file2] ...\n", argv[0]);
+        console_out("Warning: No input files provided.\n");
+        console_out(USAGE, argv[0], argv[0], argv[0], argv[0]);
+        free(assembler_options.files);
+        asm_macro_library_close(macro_library);
         return 0;
     }
 
+    if (assembler_options.stats != STATS_OFF)
+    {
+        stats = (FileStats *)calloc(assembler_options.file_count, sizeof(FileStats));
+        if (!stats)
+        {
+            print_error(MEMORY_ALLOCATION_ERROR, 0, "allocating the stats");
+            free(assembler_options.files);
+            asm_macro_library_close(macro_library);
+            return 1;
+        }
+
+        /* JSON is for programs, so it never shares stdout with the status lines */
+        if (assembler_options.stats_file)
+            stats_stream = fopen(assembler_options.stats_file, "w");
+        else if (assembler_options.stats == STATS_JSON || assembler_options.read_stdin)
+            stats_stream = stderr;
+        else
+            stats_stream = stdout;
+        if (!stats_stream)
+        {
+            print_error(FILE_ERROR, 0, "cannot write the stats file");
+            free(stats);
+            free(assembler_options.files);
+            asm_macro_library_close(macro_library);
+            return 1;
+        }
+    }
+
     /* Process all input files */
-    success = process_files(argc, argv);
+    if (assembler_options.read_stdin)
+        success = process_stdin(stats);
+    else
+        success = process_files(assembler_options.files, assembler_options.file_count, stats);
+
+    if (stats)
+    {
+        print_stats(stats_stream, assembler_options.files, stats, assembler_options.file_count, assembler_options.stats);
+        if (assembler_options.stats_file && fclose(stats_stream) != 0)
+        {
+            print_error(FILE_ERROR, 0, "cannot write the stats file");
+            success = FALSE;
+        }
+        free(stats);
+    }
+    free(assembler_options.files);
+    asm_macro_library_close(macro_library);
+
+    if (assembler_options.cache_dir)
+    {
+        unsigned long hits, misses;
+
+        cache_counts(&hits, &misses);
+        log_info(("Cache: %lu hits, %lu misses\n", hits, misses));
+    }
 
     if (!success)
     {
-        printf("Assembler terminated due to errors.\n");
+        console_out("Assembler terminated due to errors.\n");
         return 1;
     }
 
-    printf("Assembly process completed successfully.\n");
+    log_info(("Assembly process completed successfully.\n"));
     return 0;
 }
 
 /**
- * @brief Process multiple input files sequentially
+ * @brief Check whether a command line argument is an option
+ * @param arg Command line argument
+ * @return TRUE for "-..." arguments
+ */
+Boolean is_option(const char *arg)
+{
+    return (arg[0] == '-' && arg[1] != '\0') ? TRUE : FALSE;
+}
+
+/**
+ * @brief Read the number given to a counting option (-j, --max-errors)
+ * @param text Digits of the option value
+ * @param limit Largest accepted value
+ * @return The count, or 0 if text is not a number between 1 and limit
+ */
+static int parse_count(const char *text, int limit)
+{
+    int count = 0;
+
+    if (!text || !*text)
+        return 0;
+    for (; *text; text++)
+    {
+        if (!isdigit((unsigned char)*text))
+            return 0;
+        if (count > (limit - (*text - '0')) / 10)
+            return 0;
+        count = count * 10 + (*text - '0');
+    }
+
+    return count;
+}
+
+/**
+ * @brief Match a long option that takes a value
+ * @param argc Number of command line arguments
+ * @param argv Array of command line arguments
+ * @param i Index of the argument; advanced past a separate value
+ * @param name Option name, e.g. "--max-errors"
+ * @param value Set to the value ("--name VALUE" or "--name=VALUE"), NULL if missing
+ * @return TRUE if argv[*i] is the option
+ */
+static Boolean long_option(int argc, char *argv[], int *i, const char *name, const char **value)
+{
+    size_t length = strlen(name);
+
+    if (strncmp(argv[*i], name, length) != 0 || (argv[*i][length] != '\0' && argv[*i][length] != '='))
+        return FALSE;
+
+    if (argv[*i][length] == '=')
+        *value = argv[*i] + length + 1;
+    else
+        *value = *i + 1 < argc ? argv[++*i] : NULL;
+    return TRUE;
+}
+
+/* Report an option whose value is missing or empty */
+static Boolean has_value(const char *option, const char *value, const char *what)
+{
+    if (value && *value)
+        return TRUE;
+    console_out("Error: %s needs %s\n", option, what);
+    return FALSE;
+}
+
+/* Read the output descriptor of --ob-fd, --ent-fd or --ext-fd; 0 (stdin) is refused */
+static Boolean parse_fd(const char *option, const char *value, int *fd)
+{
+    *fd = parse_count(value, INT_MAX);
+    if (*fd > 0)
+        return TRUE;
+    console_out("Error: %s needs an output file descriptor\n", option);
+    return FALSE;
+}
+
+/**
+ * @brief Read the command line into assembler_options
  * @param argc Number of command line arguments
  * @param argv Array of command line arguments
+ * @return FALSE if an option is not recognized or malformed
+ *
+ * Options may appear anywhere among the file names:
+ *   --keep-am   also write the macro-expanded source to <name>.am
+ *   -j N        assemble up to N files at the same time
+ *   --max-errors N  stop the first pass of a file after N errors
+ *   -q          print diagnostics only
+ *   -v, -vv     also print phase progress / per-line tracing
+ *   --serve SOCKET   run as a daemon assembling requests from SOCKET
+ *   --client SOCKET  let the daemon on SOCKET assemble the files
+ *   --cache-dir DIR  reuse the outputs of unchanged sources from DIR
+ *   --stats[=json]   report per-phase time and counters for every file;
+ *                    the JSON report goes to stderr
+ *   --stats-file FILE  write the --stats report (text unless =json) to FILE
+ *   --macro-lib FILE        make the macros of a library built with
+ *                           --build-macro-lib available to every file
+ *   --build-macro-lib OUT   compile the mcro blocks of the one input
+ *                           file into the library OUT instead of assembling
+ *   - or --stdin     pipe mode: assemble stdin instead of files
+ *   --ob-fd N        pipe mode: write the object to descriptor N (default 1)
+ *   --ent-fd N, --ext-fd N  pipe mode: write the entries / externals to N
+ * Everything else is an input file; the files are collected in
+ * assembler_options.files in command line order.
+ */
+Boolean parse_options(int argc, char *argv[])
+{
+    const char *value;
+    int i;
+
+    assembler_options.files = (const char **)malloc(argc * sizeof(const char *));
+    if (!assembler_options.files)
+    {
+        print_error(MEMORY_ALLOCATION_ERROR, 0, "allocating the file list");
+        return FALSE;
+    }
+    assembler_options.file_count = 0;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-") == 0 || strcmp(argv[i], "--stdin") == 0)
+        {
+            assembler_options.read_stdin = TRUE;
+        }
+        else if (!is_option(argv[i]))
+        {
+            assembler_options.files[assembler_options.file_count++] = argv[i];
+        }
+        else if (strcmp(argv[i], "--keep-am") == 0)
+        {
+            assembler_options.keep_am = TRUE;
+        }
+        else if (long_option(argc, argv, &i, "--max-errors", &value))
+        {
+            assembler_options.max_errors = parse_count(value, INT_MAX);
+            if (assembler_options.max_errors == 0)
+            {
+                console_out("Error: --max-errors needs a positive error count\n");
+                return FALSE;
+            }
+        }
+        else if (long_option(argc, argv, &i, "--serve", &value))
+        {
+            if (!has_value("--serve", value, "a socket path"))
+                return FALSE;
+            assembler_options.serve_socket = value;
+        }
+        else if (long_option(argc, argv, &i, "--client", &value))
+        {
+            if (!has_value("--client", value, "a socket path"))
+                return FALSE;
+            assembler_options.client_socket = value;
+        }
+        else if (long_option(argc, argv, &i, "--cache-dir", &value))
+        {
+            if (!has_value("--cache-dir", value, "a directory"))
+                return FALSE;
+            assembler_options.cache_dir = value;
+        }
+        else if (long_option(argc, argv, &i, "--stats-file", &value))
+        {
+            if (!has_value("--stats-file", value, "a file"))
+                return FALSE;
+            assembler_options.stats_file = value;
+            if (assembler_options.stats == STATS_OFF)
+                assembler_options.stats = STATS_TEXT;
+        }
+        else if (long_option(argc, argv, &i, "--macro-lib", &value))
+        {
+            if (!has_value("--macro-lib", value, "a library file"))
+                return FALSE;
+            assembler_options.macro_lib = value;
+        }
+        else if (long_option(argc, argv, &i, "--build-macro-lib", &value))
+        {
+            if (!has_value("--build-macro-lib", value, "an output file"))
+                return FALSE;
+            assembler_options.build_macro_lib = value;
+        }
+        else if (long_option(argc, argv, &i, "--ob-fd", &value))
+        {
+            if (!parse_fd("--ob-fd", value, &assembler_options.ob_fd))
+                return FALSE;
+        }
+        else if (long_option(argc, argv, &i, "--ent-fd", &value))
+        {
+            if (!parse_fd("--ent-fd", value, &assembler_options.ent_fd))
+                return FALSE;
+        }
+        else if (long_option(argc, argv, &i, "--ext-fd", &value))
+        {
+            if (!parse_fd("--ext-fd", value, &assembler_options.ext_fd))
+                return FALSE;
+        }
+        else if (strcmp(argv[i], "--stats") == 0 || strcmp(argv[i], "--stats=text") == 0)
+        {
+            assembler_options.stats = STATS_TEXT;
+        }
+        else if (strcmp(argv[i], "--stats=json") == 0)
+        {
+            assembler_options.stats = STATS_JSON;
+        }
+        else if (strcmp(argv[i], "-q") == 0)
+        {
+            log_level = LOG_QUIET;
+        }
+        else if (strcmp(argv[i], "-v") == 0)
+        {
+            log_level = LOG_VERBOSE;
+        }
+        else if (strcmp(argv[i], "-vv") == 0)
+        {
+            log_level = LOG_DEBUG;
+        }
+        else if (strncmp(argv[i], "-j", 2) == 0)
+        {
+            const char *count = argv[i][2] ? argv[i] + 2 : (i + 1 < argc ? argv[++i] : NULL);
+
+            assembler_options.jobs = parse_count(count, MAX_JOBS);
+            if (assembler_options.jobs == 0)
+            {
+                console_out("Error: -j needs a job count between 1 and %d\n", MAX_JOBS);
+                return FALSE;
+            }
+        }
+        else
+        {
+            console_out("Error: Unknown option '%s'\n", argv[i]);
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+/* Assemble one file, with the status lines around it */
+static Boolean assemble_file(const char *filename, FileStats *stats)
+{
+    Boolean success;
+
+    log_info(("Processing file: %s\n", filename));
+
+    success = process_single_file(filename, stats);
+    if (!success)
+    {
+        console_out("Error processing file: %s\n", filename);
+    }
+
+    return success;
+}
+
+/* Worker thread: assemble files from the queue until none are left */
+static void *run_jobs(void *arg)
+{
+    JobQueue *queue = (JobQueue *)arg;
+    FileJob *job;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&queue->lock);
+        job = queue->next < queue->count ? &queue->jobs[queue->next++] : NULL;
+        pthread_mutex_unlock(&queue->lock);
+        if (!job)
+            break;
+
+        set_console_capture(&job->output);
+        job->success = assemble_file(job->filename, job->stats);
+        set_console_capture(NULL);
+
+        pthread_mutex_lock(&queue->lock);
+        job->done = TRUE;
+        pthread_cond_broadcast(&queue->finished);
+        pthread_mutex_unlock(&queue->lock);
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Assemble the files on several threads
+ * @param files Input files (base names)
+ * @param file_count Number of input files
+ * @param stats Per-file stats, or NULL
+ * @param thread_count Number of worker threads
  * @return TRUE if all files processed successfully, FALSE otherwise
+ *
+ * Each file's output is captured while it is assembled and printed
+ * once the file is done, in input order, so the output matches a
+ * sequential run.
  */
-/* Process all files provided in command line arguments */
-Boolean process_files(int argc, char *argv[])
+static Boolean process_files_parallel(const char **files, int file_count, FileStats *stats,
+                                      int thread_count)
 {
+    JobQueue queue;
+    pthread_t *threads;
+    int started = 0;
     int i;
     Boolean overall_success = TRUE;
 
-    for (i = 1; i < argc; i++)
+    queue.jobs = (FileJob *)malloc(file_count * sizeof(FileJob));
+    threads = (pthread_t *)malloc(thread_count * sizeof(pthread_t));
+    if (!queue.jobs || !threads)
     {
-        printf("Processing file: %s\n", argv[i]);
+        print_error(MEMORY_ALLOCATION_ERROR, 0, "allocating the job queue");
+        free(queue.jobs);
+        free(threads);
+        return FALSE;
+    }
+
+    for (i = 0; i < file_count; i++)
+    {
+        queue.jobs[i].filename = files[i];
+        queue.jobs[i].stats = stats ? &stats[i] : NULL;
+        init_console_capture(&queue.jobs[i].output);
+        queue.jobs[i].success = FALSE;
+        queue.jobs[i].done = FALSE;
+    }
+    queue.count = file_count;
+    queue.next = 0;
+    pthread_mutex_init(&queue.lock, NULL);
+    pthread_cond_init(&queue.finished, NULL);
 
-        if (!process_single_file(argv[i]))
+    while (started < thread_count && pthread_create(&threads[started], NULL, run_jobs, &queue) == 0)
+    {
+        started++;
+    }
+    if (started == 0)
+    {
+        run_jobs(&queue); /* no threads available - do the work here */
+    }
+
+    for (i = 0; i < file_count; i++)
+    {
+        pthread_mutex_lock(&queue.lock);
+        while (!queue.jobs[i].done)
         {
-            overall_success = FALSE;
-            printf("Error processing file: %s\n", argv[i]);
+            pthread_cond_wait(&queue.finished, &queue.lock);
         }
+        pthread_mutex_unlock(&queue.lock);
+
+        flush_console_capture(&queue.jobs[i].output);
+        free_console_capture(&queue.jobs[i].output);
+        if (!queue.jobs[i].success)
+            overall_success = FALSE;
     }
 
+    for (i = 0; i < started; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    pthread_mutex_destroy(&queue.lock);
+    pthread_cond_destroy(&queue.finished);
+    free(queue.jobs);
+    free(threads);
     return overall_success;
 }
 
+/**
+ * @brief Process the input files, in parallel when -j asks for it
+ * @param files Input files (base names)
+ * @param file_count Number of input files
+ * @param stats One FileStats per file to fill, or NULL
+ * @return TRUE if all files processed successfully, FALSE otherwise
+ */
+Boolean process_files(const char **files, int file_count, FileStats *stats)
+{
+    int i;
+    Boolean overall_success = TRUE;
+
+    if (assembler_options.jobs > 1 && file_count > 1)
+    {
+        return process_files_parallel(files, file_count, stats,
+                                      assembler_options.jobs < file_count ? assembler_options.jobs : file_count);
+    }
+
+    for (i = 0; i < file_count; i++)
+    {
+        if (!assemble_file(files[i], stats ? &stats[i] : NULL))
+            overall_success = FALSE;
+    }
+
+    return overall_success;
+}
+
+/* Write one output text next to the input file, counting its bytes; FALSE (reported) on failure */
+static Boolean write_output_file(Arena *arena, const char *filename, const char *extension,
+                                 const char *kind, const AsmText *text, long *bytes_written)
+{
+    char *output_filename = create_filename_with_extension(arena, filename, extension);
+
+    if (!output_filename)
+    {
+        print_error(MEMORY_ALLOCATION_ERROR, 0, "allocating buffer for output filename");
+        return FALSE;
+    }
+
+    if (!write_text_to_file(output_filename, text->data, text->length))
+    {
+        console_out("Error: Cannot create %s file %s\n", kind, output_filename);
+        return FALSE;
+    }
+
+    *bytes_written += (long)text->length;
+    log_info(("Generated %s file: %s\n", kind, output_filename));
+    return TRUE;
+}
+
+/* Phases 1-5 run in memory (asm.c), here or in the --serve daemon,
+   unless the cache already has the outputs of this exact source */
+static Boolean assemble_text(const char *filename, const TextBuffer *source, AsmResult *result, Boolean *cached)
+{
+    ConsoleCapture *outer = get_console_capture();
+    ConsoleCapture output; /* what the assembly prints, kept with the cache entry */
+    Boolean success;
+
+    if (assembler_options.cache_dir)
+    {
+        if (cache_lookup(assembler_options.cache_dir, filename, source->data, source->length, result))
+        {
+            *cached = TRUE;
+            return TRUE;
+        }
+        init_console_capture(&output);
+        set_console_capture(&output);
+    }
+
+    if (assembler_options.client_socket)
+    {
+        success = client_assemble(assembler_options.client_socket,
+                                  (assembler_options.keep_am || assembler_options.cache_dir) ? SERVE_FLAG_KEEP_AM : 0,
+                                  filename,
+                                  source->data, source->length, assembler_options.max_errors, result);
+    }
+    else
+    {
+        success = asm_assemble_source(filename, source->data, source->length,
+                                      assembler_options.max_errors, result) ? TRUE : FALSE;
+    }
+    if (assembler_options.cache_dir)
+    {
+        set_console_capture(outer);
+        replay_console_capture(&output);
+        /* cache entries always carry the .am text, for later --keep-am hits */
+        if (success && result->am_text.data)
+            cache_store(assembler_options.cache_dir, filename, source->data, source->length, result, &output);
+        free_console_capture(&output);
+    }
+    return success;
+}
+
+/* Pipe mode: write one output text to a descriptor; an output without
+   one is reported and skipped */
+static Boolean write_output_fd(int fd, const char *kind, const char *option,
+                               const AsmText *text, long *bytes_written)
+{
+    if (fd < 0)
+    {
+        console_out("Warning: %s of %s not written - no %s given\n", kind, STDIN_NAME, option);
+        return TRUE;
+    }
+
+    if (!write_text_to_fd(fd, text->data, text->length))
+    {
+        console_out("Error: Cannot write %s to file descriptor %d\n", kind, fd);
+        return FALSE;
+    }
+
+    *bytes_written += (long)text->length;
+    log_info(("Wrote %s to file descriptor %d\n", kind, fd));
+    return TRUE;
+}
+
+/**
+ * @brief Pipe mode: assemble stdin and write the outputs to descriptors
+ * @param stats Filled in for --stats, or NULL
+ * @return TRUE if the source assembled and every output was written
+ *
+ * No file name is involved: stdin is mapped when it is a regular file
+ * and otherwise read in bounded chunks straight into the source buffer,
+ * and the outputs are written from memory, so nothing touches the disk.
+ */
+Boolean process_stdin(FileStats *stats)
+{
+    Boolean success;
+    Boolean cached = FALSE;
+    TextBuffer source;
+    AsmResult result;
+    PhaseClock clock;
+    long bytes_written = 0;
+
+    log_info(("Processing file: %s\n", STDIN_NAME));
+
+    init_text_buffer(&source);
+    if (!map_fd_into_text_buffer(STDIN_FILENO, &source))
+    {
+        print_error(FILE_ERROR, 0, "cannot read standard input");
+        release_mapped_text_buffer(&source);
+        return FALSE;
+    }
+
+    success = assemble_text(STDIN_NAME, &source, &result, &cached);
+    release_mapped_text_buffer(&source);
+
+    /* Writing the outputs is part of the output phase */
+    start_phase_clock(&clock);
+    if (success)
+    {
+        success = write_output_fd(assembler_options.ob_fd, "object", "--ob-fd", &result.ob_text, &bytes_written);
+        if (success && result.ent_text.data)
+            success = write_output_fd(assembler_options.ent_fd, "entries", "--ent-fd", &result.ent_text, &bytes_written);
+        if (success && result.ext_text.data)
+            success = write_output_fd(assembler_options.ext_fd, "externals", "--ext-fd", &result.ext_text, &bytes_written);
+    }
+
+    if (stats)
+    {
+        stop_phase_clock(&clock, &result.stats, ASM_PHASE_OUTPUT);
+        stats->assembly = result.stats;
+        stats->bytes_written = bytes_written;
+        stats->cached = cached;
+    }
+
+    asm_free_result(&result);
+    if (!success)
+    {
+        console_out("Error processing file: %s\n", STDIN_NAME);
+        return FALSE;
+    }
+
+    log_info(("Successfully processed file: %s\n", STDIN_NAME));
+    return TRUE;
+}
+
+/* Compile the mcro blocks of <filename>.as into the macro library library_path */
+Boolean build_macro_library(const char *filename, const char *library_path)
+{
+    char *input_filename;
+    TextBuffer source;
+    Arena arena; /* file name */
+    Boolean success;
+
+    arena_init(&arena);
+    input_filename = create_filename_with_extension(&arena, filename, AS_EXTENSION);
+    if (!input_filename)
+    {
+        print_error(MEMORY_ALLOCATION_ERROR, 0, "allocating buffer for input filename");
+        arena_release(&arena);
+        return FALSE;
+    }
+
+    init_text_buffer(&source);
+    if (!map_file_into_text_buffer(input_filename, &source))
+    {
+        print_error(FILE_ERROR, 0, file_exists(input_filename) ? "cannot read input file"
+                                                                : "input file does not exist");
+        release_mapped_text_buffer(&source);
+        arena_release(&arena);
+        return FALSE;
+    }
+
+    success = asm_macro_library_build(filename, source.data, source.length, library_path) ? TRUE : FALSE;
+    release_mapped_text_buffer(&source);
+    arena_release(&arena);
+    return success;
+}
+
 /**
  * @brief Process a single assembly source file through all phases
  * @param filename Base filename (without extension)
+ * @param stats Filled in for --stats, or NULL
  * @return TRUE if file processed successfully, FALSE otherwise
- * 
- * This function coordinates all assembly phases for a single file:
- * 1. Pre-assembler phase (macro expansion)
+ *
+ * Reads <filename>.as once and hands it to assemble_text, which runs
+ * the phases in memory (or asks the --serve daemon or the cache):
+ * 1. Pre-assembler (macro expansion)
  * 2. First pass (syntax check and symbol table building)
  * 3. Memory image building
  * 4. Second pass (code generation and address resolution)
  * 5. Output file generation
+ * then writes the .am/.ob/.ent/.ext files next to the input.
+ *
+ * All per-file state lives in a context owned by the library call, so
+ * several files can be assembled on different threads at once.
  */
-/* Process a single input file through all phases */
-Boolean process_single_file(const char *filename)
+Boolean process_single_file(const char *filename, FileStats *stats)
 {
     char *input_filename = NULL;
     char *am_filename = NULL;
     Boolean success = FALSE;
-    MemoryImage memory;
+    Boolean cached = FALSE;
+    TextBuffer source;
+    AsmResult result;
+    Arena arena; /* file names */
+    PhaseClock clock;
+    long bytes_written = 0;
+
+    arena_init(&arena);
 
     /* Create full input filename with .as extension */
-    input_filename = create_filename_with_extension(filename, AS_EXTENSION);
+    input_filename = create_filename_with_extension(&arena, filename, AS_EXTENSION);
     if (!input_filename)
     {
         print_error(MEMORY_ALLOCATION_ERROR, 0, "allocating buffer for input filename");
+        arena_release(&arena);
         return FALSE;
     }
 
-    /* Check if input file exists */
-    if (!file_exists(input_filename))
+    /* The source is opened once - a second open would drain a pipe */
+    init_text_buffer(&source);
+    if (!map_file_into_text_buffer(input_filename, &source))
     {
-        print_error(FILE_ERROR, 0, "input file does not exist");
-        free(input_filename);
+        print_error(FILE_ERROR, 0, file_exists(input_filename) ? "cannot read input file"
+                                                                : "input file does not exist");
+        release_mapped_text_buffer(&source);
+        arena_release(&arena);
         return FALSE;
     }
 
-    /* Create .am filename */
-    am_filename = create_filename_with_extension(filename, AM_EXTENSION);
-    if (!am_filename)
-    {
-        print_error(MEMORY_ALLOCATION_ERROR, 0, "allocating buffer for .am filename");
-        free(input_filename);
-        return FALSE;
-    }
+    success = assemble_text(filename, &source, &result, &cached);
+    release_mapped_text_buffer(&source);
 
-    printf("\n=== PHASE 1: PRE-ASSEMBLER ===\n");
+    /* Writing the files is part of the output phase */
+    start_phase_clock(&clock);
 
-    /* Phase 1: Pre-assembler (macro expansion) */
-    success = preassembler(filename);
-    if (!success)
+    /* The .am file is only an artifact - the later phases read memory */
+    if (assembler_options.keep_am && result.am_text.data)
     {
-        printf("Pre-assembler phase failed for file: %s\n", filename);
-        free(input_filename);
-        free(am_filename);
-        return FALSE;
+        am_filename = create_filename_with_extension(&arena, filename, AM_EXTENSION);
+        if (!am_filename || !write_text_to_file(am_filename, result.am_text.data, result.am_text.length))
+        {
+            print_error(FILE_ERROR, 0, "cannot write .am file");
+        }
+        else
+        {
+            bytes_written += (long)result.am_text.length;
+        }
     }
-    printf("Pre-assembler phase completed successfully.\n");
-
-    printf("\n=== PHASE 2: FIRST PASS ===\n");
 
-    /* Phase 2: First pass (symbol table building) */
-    first_pass(am_filename);
-
-    printf("\n=== PHASE 3: MEMORY IMAGE BUILDING ===\n");
-
-    /* Phase 3: Build memory image */
-    if (!build_memory_image(am_filename, &memory))
+    /* Output files: .ob always, .ent/.ext only when there is something in them */
+    if (success)
     {
-        printf("Memory image building failed for file: %s\n", filename);
-        free(input_filename);
-        free(am_filename);
-        return FALSE;
+        success = write_output_file(&arena, filename, OB_EXTENSION, "object", &result.ob_text, &bytes_written);
+        if (success && result.ent_text.data)
+            success = write_output_file(&arena, filename, ENT_EXTENSION, "entries", &result.ent_text, &bytes_written);
+        if (success && result.ext_text.data)
+            success = write_output_file(&arena, filename, EXT_EXTENSION, "externals", &result.ext_text, &bytes_written);
     }
-    printf("Memory image built successfully.\n");
 
-    printf("\n=== PHASE 4: SECOND PASS ===\n");
+    if (stats)
+    {
+        stop_phase_clock(&clock, &result.stats, ASM_PHASE_OUTPUT);
+        stats->assembly = result.stats;
+        stats->bytes_written = bytes_written;
+        stats->cached = cached;
+    }
 
-    /* Phase 4: Second pass (complete encoding and generate output) */
-    if (!second_pass(am_filename, &memory))
+    asm_free_result(&result);
+    arena_release(&arena);
+    if (!success)
     {
-        printf("Second pass failed for file: %s\n", filename);
-        free(input_filename);
-        free(am_filename);
         return FALSE;
     }
-    printf("Second pass completed successfully.\n");
-
-    /* Cleanup memory */
-    free_memory_image(&memory);
 
-    /* Cleanup */
-    free(input_filename);
-    free(am_filename);
-
-    printf("Successfully processed file: %s\n", filename);
+    log_info(("Successfully processed file: %s\n", filename));
     return TRUE;
-}
\ No newline at end of file
+}
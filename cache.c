@@ -0,0 +1,277 @@
+/**
+ * @file cache.c
+ * @brief Content-hash cache of assembled outputs (--cache-dir)
+ *
+ * An entry is named after an FNV-1a hash of ASM_VERSION, the options
+ * and the source text, plus the source length. The options are the log
+ * level and the file name, which both show in what the assembly prints.
+ * It holds the source and the options themselves, so that a hash
+ * collision is caught by comparing them, then the console output, one
+ * section per run of a stream, and the output texts:
+ *
+ *   asm-cache <ASM_VERSION>\n
+ *   source <length>\n<bytes>
+ *   options <length>\n<log level>\n<name>
+ *   out <length>\n<bytes>     (or err; any number of them)
+ *   am <length>\n<bytes>      (length -1: not produced)
+ *   ob ...  ent ...  ext ...
+ *
+ * Only successful assemblies are stored. A hit prints the console
+ * output again, so it looks the same as assembling the file. An entry is written to a
+ * temporary file in the cache directory and renamed into place, so
+ * builds sharing the directory never see a partial entry.
+ */
+
+/* for mkdir, getpid and the pthread declarations under -ansi */
+#define _POSIX_C_SOURCE 200112L
+
+#include "cache.h"
+#include "hash_utils.h"
+#include "text_buffer.h"
+#include "console.h"
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#define CACHE_MAGIC "asm-cache " ASM_VERSION "\n"
+#define CACHE_NAME_SIZE 64 /* "/<hash>-<length>.cache", or the temporary suffix */
+#define CACHE_SECTION_HEADER_SIZE 32 /* "<label> <length>\n" */
+#define CACHE_LEVEL_SIZE 16 /* "<log level>\n" */
+
+/* -j runs several lookups and stores at once */
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned long cache_hits = 0;
+static unsigned long cache_misses = 0;
+static unsigned long temporary_count = 0; /* makes temporary names unique in this process */
+
+/* The options section of an entry; NULL when out of memory */
+static char *entry_options(const char *name)
+{
+    char *options = malloc(CACHE_LEVEL_SIZE + strlen(name) + 1);
+
+    /* levels above the compiled-in one print the same as it */
+    if (options)
+        sprintf(options, "%d\n%s", log_level < ASM_LOG_LEVEL ? log_level : ASM_LOG_LEVEL, name);
+    return options;
+}
+
+/* Path of the entry for a source; NULL when out of memory */
+static char *entry_path(const char *dir, const char *options, const char *src, size_t len)
+{
+    unsigned long hash = hash_bytes(HASH_INITIAL, ASM_VERSION, sizeof(ASM_VERSION));
+    char name[CACHE_NAME_SIZE];
+    char *path;
+
+    hash = hash_bytes(hash, options, strlen(options) + 1);
+    hash = hash_bytes(hash, src, len);
+    sprintf(name, "/%08lx-%lx.cache", hash, (unsigned long)len);
+
+    path = malloc(strlen(dir) + strlen(name) + 1);
+    if (path)
+        sprintf(path, "%s%s", dir, name);
+    return path;
+}
+
+/* Read "<label> <length>\n<bytes>" at *position; text points into entry */
+static Boolean read_section(const TextBuffer *entry, size_t *position, const char *label, AsmText *text)
+{
+    size_t label_length = strlen(label);
+    const char *start = entry->data + *position;
+    const char *end = entry->data + entry->length;
+    char *number_end;
+    long length;
+
+    if ((size_t)(end - start) < label_length + 1 ||
+        memcmp(start, label, label_length) != 0 || start[label_length] != ' ')
+        return FALSE;
+
+    length = strtol(start + label_length + 1, &number_end, 10);
+    if (number_end >= end || *number_end != '\n' || length < -1)
+        return FALSE;
+    start = number_end + 1;
+
+    text->data = NULL;
+    text->length = 0;
+    if (length >= 0)
+    {
+        if ((unsigned long)(end - start) < (unsigned long)length)
+            return FALSE;
+        text->data = (char *)start;
+        text->length = (size_t)length;
+        start += length;
+    }
+
+    *position = start - entry->data;
+    return TRUE;
+}
+
+/* Append "<label> <length>\n<bytes>"; a NULL text is stored with length -1 */
+static Boolean put_section(TextBuffer *entry, const char *label, const char *data, size_t length)
+{
+    char header[CACHE_SECTION_HEADER_SIZE];
+
+    sprintf(header, "%s %ld\n", label, data ? (long)length : -1L);
+    return append_to_text_buffer(entry, header, strlen(header)) &&
+           (!data || length == 0 || append_to_text_buffer(entry, data, length));
+}
+
+/* Read an out or err section at *position */
+static Boolean read_console_run(const TextBuffer *entry, size_t *position, FILE **stream, AsmText *text)
+{
+    if (read_section(entry, position, "out", text))
+        *stream = stdout;
+    else if (read_section(entry, position, "err", text))
+        *stream = stderr;
+    else
+        return FALSE;
+    return text->data != NULL;
+}
+
+/* Copy a section of an entry into a result text */
+static Boolean copy_text(AsmText *copy, const AsmText *text)
+{
+    if (!text->data)
+        return TRUE;
+
+    copy->data = malloc(text->length + 1);
+    if (!copy->data)
+        return FALSE;
+    memcpy(copy->data, text->data, text->length);
+    copy->data[text->length] = '\0';
+    copy->length = text->length;
+    return TRUE;
+}
+
+static void count(unsigned long *counter)
+{
+    pthread_mutex_lock(&cache_lock);
+    (*counter)++;
+    pthread_mutex_unlock(&cache_lock);
+}
+
+/* Look for the outputs of src in dir; counts a hit or a miss */
+Boolean cache_lookup(const char *dir, const char *name, const char *src, size_t len, AsmResult *out)
+{
+    char *options = entry_options(name);
+    char *path = options ? entry_path(dir, options, src, len) : NULL;
+    size_t position = sizeof(CACHE_MAGIC) - 1;
+    size_t output_position = 0;
+    TextBuffer entry;
+    AsmText source, stored_options, run, am, ob, ent, ext;
+    FILE *stream;
+    Boolean hit = FALSE;
+
+    memset(out, 0, sizeof(*out));
+    init_text_buffer(&entry);
+
+    if (path && read_file_into_text_buffer(path, &entry) &&
+        entry.length >= position && memcmp(entry.data, CACHE_MAGIC, position) == 0 &&
+        read_section(&entry, &position, "source", &source) &&
+        source.data && source.length == len && (len == 0 || memcmp(source.data, src, len) == 0) &&
+        read_section(&entry, &position, "options", &stored_options) && stored_options.data &&
+        stored_options.length == strlen(options) && memcmp(stored_options.data, options, stored_options.length) == 0)
+    {
+        output_position = position;
+        while (read_console_run(&entry, &position, &stream, &run))
+            ;
+    }
+
+    if (output_position &&
+        read_section(&entry, &position, "am", &am) &&
+        read_section(&entry, &position, "ob", &ob) && ob.data &&
+        read_section(&entry, &position, "ent", &ent) &&
+        read_section(&entry, &position, "ext", &ext) &&
+        position == entry.length)
+    {
+        hit = copy_text(&out->am_text, &am) && copy_text(&out->ob_text, &ob) &&
+              copy_text(&out->ent_text, &ent) && copy_text(&out->ext_text, &ext);
+        if (!hit)
+            asm_free_result(out);
+    }
+
+    if (hit)
+    {
+        log_verbose(("Cache hit for file: %s\n", name));
+        while (read_console_run(&entry, &output_position, &stream, &run))
+            console_write_text(stream, run.data, run.length);
+    }
+
+    count(hit ? &cache_hits : &cache_misses);
+    free(options);
+    free(path);
+    free_text_buffer(&entry);
+    return hit;
+}
+
+/* Store the outputs of a successful assembly; a failure only costs the next lookup */
+void cache_store(const char *dir, const char *name, const char *src, size_t len,
+                 const AsmResult *result, const ConsoleCapture *output)
+{
+    char *options = entry_options(name);
+    char *path = options ? entry_path(dir, options, src, len) : NULL;
+    char *temporary = NULL;
+    unsigned long number;
+    TextBuffer entry;
+    size_t start = 0;
+    Boolean stored;
+    int i;
+
+    init_text_buffer(&entry);
+    stored = path &&
+             append_to_text_buffer(&entry, CACHE_MAGIC, sizeof(CACHE_MAGIC) - 1) &&
+             put_section(&entry, "source", src ? src : "", len) &&
+             put_section(&entry, "options", options, strlen(options));
+
+    for (i = 0; stored && i < output->run_count; i++)
+    {
+        stored = put_section(&entry, output->runs[i].stream == stderr ? "err" : "out",
+                             output->text.data + start, output->runs[i].end - start);
+        start = output->runs[i].end;
+    }
+
+    stored = stored &&
+             put_section(&entry, "am", result->am_text.data, result->am_text.length) &&
+             put_section(&entry, "ob", result->ob_text.data, result->ob_text.length) &&
+             put_section(&entry, "ent", result->ent_text.data, result->ent_text.length) &&
+             put_section(&entry, "ext", result->ext_text.data, result->ext_text.length);
+
+    /* the directory is created on first use; another build may have made it */
+    if (stored && mkdir(dir, 0777) != 0 && errno != EEXIST)
+        stored = FALSE;
+
+    if (stored)
+    {
+        pthread_mutex_lock(&cache_lock);
+        number = temporary_count++;
+        pthread_mutex_unlock(&cache_lock);
+
+        temporary = malloc(strlen(path) + CACHE_NAME_SIZE);
+        stored = temporary != NULL;
+        if (stored)
+        {
+            sprintf(temporary, "%s.%ld.%lu.tmp", path, (long)getpid(), number);
+            stored = write_text_buffer_to_file(&entry, temporary) && rename(temporary, path) == 0;
+            if (!stored)
+                remove(temporary);
+        }
+    }
+
+    if (!stored)
+        log_verbose(("Cannot write cache entry %s\n", path ? path : dir));
+
+    free(temporary);
+    free(options);
+    free(path);
+    free_text_buffer(&entry);
+}
+
+/* Hits and misses since the program started */
+void cache_counts(unsigned long *hits, unsigned long *misses)
+{
+    pthread_mutex_lock(&cache_lock);
+    *hits = cache_hits;
+    *misses = cache_misses;
+    pthread_mutex_unlock(&cache_lock);
+}
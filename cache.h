@@ -0,0 +1,21 @@
+/* cache.h - content-hash cache of assembled outputs (--cache-dir) */
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "assembler.h"
+#include "asm.h"
+#include "console.h"
+
+/* Look for the outputs of src, assembled as name, in dir. On a hit the
+   .am/.ob/.ent/.ext texts of out are filled (release with
+   asm_free_result) and what the assembly printed is printed again. */
+Boolean cache_lookup(const char *dir, const char *name, const char *src, size_t len, AsmResult *out);
+
+/* Remember the outputs of a successful assembly of src and its output */
+void cache_store(const char *dir, const char *name, const char *src, size_t len,
+                 const AsmResult *result, const ConsoleCapture *output);
+
+/* Hits and misses since the program started */
+void cache_counts(unsigned long *hits, unsigned long *misses);
+
+#endif /* CACHE_H */
@@ -0,0 +1,186 @@
+/* console.c - program output, optionally captured per file */
+#define _POSIX_C_SOURCE 200112L
+
+#include "console.h"
+#include "text_buffer.h"
+#include <stdarg.h>
+#include <pthread.h>
+
+/* longest single message; longer ones are cut */
+#define CONSOLE_MESSAGE_SIZE 1024
+
+int log_level = LOG_NORMAL;
+
+/* where stdout output goes instead, e.g. stderr in pipe mode; NULL = stdout */
+static FILE *stdout_replacement = NULL;
+
+static pthread_key_t capture_key;
+static pthread_once_t capture_key_once = PTHREAD_ONCE_INIT;
+
+static void create_capture_key(void)
+{
+    pthread_key_create(&capture_key, NULL);
+}
+
+static ConsoleCapture *current_capture(void)
+{
+    pthread_once(&capture_key_once, create_capture_key);
+    return (ConsoleCapture *)pthread_getspecific(capture_key);
+}
+
+void redirect_console_stdout(FILE *stream)
+{
+    stdout_replacement = stream;
+}
+
+void set_console_capture(ConsoleCapture *capture)
+{
+    pthread_once(&capture_key_once, create_capture_key);
+    pthread_setspecific(capture_key, capture);
+}
+
+ConsoleCapture *get_console_capture(void)
+{
+    return current_capture();
+}
+
+/* append text to the capture, starting a new run when the stream changes */
+static void capture_text(ConsoleCapture *capture, FILE *stream, const char *text, size_t length)
+{
+    ConsoleRun *last = capture->run_count ? &capture->runs[capture->run_count - 1] : NULL;
+
+    if (!append_to_text_buffer(&capture->text, text, length))
+        return;
+
+    if (last && last->stream == stream)
+    {
+        last->end = capture->text.length;
+        return;
+    }
+
+    if (capture->run_count == capture->run_capacity)
+    {
+        int new_capacity = capture->run_capacity ? capture->run_capacity * 2 : 16;
+        ConsoleRun *runs = realloc(capture->runs, new_capacity * sizeof(ConsoleRun));
+        if (!runs)
+            return;
+        capture->runs = runs;
+        capture->run_capacity = new_capacity;
+    }
+
+    capture->runs[capture->run_count].stream = stream;
+    capture->runs[capture->run_count].end = capture->text.length;
+    capture->run_count++;
+}
+
+static void console_write(FILE *stream, const char *format, va_list args)
+{
+    ConsoleCapture *capture = current_capture();
+    char message[CONSOLE_MESSAGE_SIZE];
+    int length;
+
+    if (stream == stdout && stdout_replacement)
+        stream = stdout_replacement;
+
+    if (!capture)
+    {
+        vfprintf(stream, format, args);
+        return;
+    }
+
+    length = vsnprintf(message, sizeof(message), format, args);
+    if (length < 0)
+        return;
+    if (length >= (int)sizeof(message))
+        length = sizeof(message) - 1;
+    capture_text(capture, stream, message, length);
+}
+
+void console_out(const char *format, ...)
+{
+    va_list args;
+
+    va_start(args, format);
+    console_write(stdout, format, args);
+    va_end(args);
+}
+
+void console_err(const char *format, ...)
+{
+    va_list args;
+
+    va_start(args, format);
+    console_write(stderr, format, args);
+    va_end(args);
+}
+
+void vconsole_err(const char *format, va_list args)
+{
+    console_write(stderr, format, args);
+}
+
+/* raw text (not a format), e.g. output replayed from another process */
+void console_write_text(FILE *stream, const char *text, size_t length)
+{
+    ConsoleCapture *capture = current_capture();
+
+    if (stream == stdout && stdout_replacement)
+        stream = stdout_replacement;
+
+    if (!capture)
+    {
+        fwrite(text, 1, length, stream);
+        return;
+    }
+
+    capture_text(capture, stream, text, length);
+}
+
+void init_console_capture(ConsoleCapture *capture)
+{
+    init_text_buffer(&capture->text);
+    capture->runs = NULL;
+    capture->run_count = 0;
+    capture->run_capacity = 0;
+}
+
+/* write the captured output to the real streams, in the original order */
+void flush_console_capture(const ConsoleCapture *capture)
+{
+    size_t start = 0;
+    int i;
+
+    for (i = 0; i < capture->run_count; i++)
+    {
+        const ConsoleRun *run = &capture->runs[i];
+
+        fflush(run->stream == stdout ? stderr : stdout);
+        fwrite(capture->text.data + start, 1, run->end - start, run->stream);
+        start = run->end;
+    }
+    fflush(stdout);
+    fflush(stderr);
+}
+
+/* print the captured output again through the console, so it lands in
+   the current capture if this thread has one */
+void replay_console_capture(const ConsoleCapture *capture)
+{
+    size_t start = 0;
+    int i;
+
+    for (i = 0; i < capture->run_count; i++)
+    {
+        console_write_text(capture->runs[i].stream, capture->text.data + start, capture->runs[i].end - start);
+        start = capture->runs[i].end;
+    }
+}
+
+void free_console_capture(ConsoleCapture *capture)
+{
+    free_text_buffer(&capture->text);
+    free(capture->runs);
+    capture->runs = NULL;
+    capture->run_count = 0;
+    capture->run_capacity = 0;
+}
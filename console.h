@@ -0,0 +1,78 @@
+/* console.h - program output, optionally captured per file */
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+#include "assembler.h"
+#include <stdarg.h>
+
+/* a stretch of captured text that went to one stream */
+typedef struct
+{
+    FILE *stream;
+    size_t end; /* offset in the capture text where the run ends */
+} ConsoleRun;
+
+/* everything one file printed, in order, for replay after a parallel run */
+typedef struct
+{
+    TextBuffer text;
+    ConsoleRun *runs;
+    int run_count;
+    int run_capacity;
+} ConsoleCapture;
+
+/* verbosity levels: -q, default, -v, -vv */
+#define LOG_QUIET 0   /* diagnostics only */
+#define LOG_NORMAL 1  /* plus one status line per file and output file */
+#define LOG_VERBOSE 2 /* plus phase progress and summaries */
+#define LOG_DEBUG 3   /* plus per-line and per-word tracing */
+
+/* most detailed level compiled in; calls above it are dropped entirely */
+#ifndef ASM_LOG_LEVEL
+#define ASM_LOG_LEVEL LOG_DEBUG
+#endif
+
+/* level chosen on the command line */
+extern int log_level;
+
+/* Leveled output to stdout. C90 has no variadic macros, so the printf
+   arguments go in double parentheses: log_debug(("Line %d\n", n)); */
+#if ASM_LOG_LEVEL >= LOG_NORMAL
+#define log_info(args) do { if (log_level >= LOG_NORMAL) console_out args; } while (0)
+#else
+#define log_info(args) do { } while (0)
+#endif
+
+#if ASM_LOG_LEVEL >= LOG_VERBOSE
+#define log_verbose(args) do { if (log_level >= LOG_VERBOSE) console_out args; } while (0)
+#else
+#define log_verbose(args) do { } while (0)
+#endif
+
+#if ASM_LOG_LEVEL >= LOG_DEBUG
+#define log_debug(args) do { if (log_level >= LOG_DEBUG) console_out args; } while (0)
+#else
+#define log_debug(args) do { } while (0)
+#endif
+
+/* printf / fprintf(stderr, ...) replacements used by every module;
+   diagnostics use these directly and are printed at every level */
+void console_out(const char *format, ...);
+void console_err(const char *format, ...);
+void vconsole_err(const char *format, va_list args);
+void console_write_text(FILE *stream, const char *text, size_t length);
+
+/* print what would go to stdout on stream instead (pipe mode, where
+   stdout carries the object); set before any output or thread */
+void redirect_console_stdout(FILE *stream);
+
+/* route this thread's output into capture (NULL prints directly again) */
+void set_console_capture(ConsoleCapture *capture);
+ConsoleCapture *get_console_capture(void);
+
+void init_console_capture(ConsoleCapture *capture);
+void flush_console_capture(const ConsoleCapture *capture);
+void replay_console_capture(const ConsoleCapture *capture);
+void free_console_capture(ConsoleCapture *capture);
+
+#endif /* CONSOLE_H */
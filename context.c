@@ -0,0 +1,71 @@
+/* context.c - state of one assembly */
+#include "context.h"
+#include "memory_builder.h"
+
+void init_assembler_context(AssemblerContext *context)
+{
+    arena_init(&context->arena);
+    init_symbol_table(&context->symbols, &context->arena);
+    init_memory_image(&context->memory);
+    context->ext_list = NULL;
+    context->entry_list = NULL;
+    context->error_count = 0;
+    context->max_errors = 0;
+    context->lines_read = 0;
+    context->macros_expanded = 0;
+    context->labels_defined = 0;
+    context->splices = NULL;
+    context->splice_count = 0;
+    context->splice_capacity = 0;
+    context->macro_library = NULL;
+}
+
+/* Empty the context for the next file, keeping its allocations warm */
+void reset_assembler_context(AssemblerContext *context)
+{
+    clear_symbol_table(&context->symbols);
+    free_memory_image(&context->memory);
+    context->ext_list = NULL;
+    context->entry_list = NULL;
+    context->error_count = 0;
+    context->max_errors = 0;
+    context->lines_read = 0;
+    context->macros_expanded = 0;
+    context->labels_defined = 0;
+    context->splice_count = 0;
+    arena_reset(&context->arena);
+}
+
+void free_assembler_context(AssemblerContext *context)
+{
+    release_symbol_table(&context->symbols);
+    free_memory_image(&context->memory);
+    context->ext_list = NULL;
+    context->entry_list = NULL;
+    free(context->splices);
+    context->splices = NULL;
+    context->splice_count = 0;
+    context->splice_capacity = 0;
+    arena_release(&context->arena);
+}
+
+/* Record a macro body expanded at offset of the expanded source */
+Boolean add_macro_splice(AssemblerContext *context, size_t offset,
+                         const MacroStatement *statements, int statement_count)
+{
+    if (context->splice_count == context->splice_capacity)
+    {
+        int new_capacity = context->splice_capacity ? context->splice_capacity * 2 : 64;
+        MacroSplice *splices = realloc(context->splices, new_capacity * sizeof(MacroSplice));
+        if (!splices)
+            return FALSE;
+        context->splices = splices;
+        context->splice_capacity = new_capacity;
+    }
+
+    context->splices[context->splice_count].offset = offset;
+    context->splices[context->splice_count].statements = statements;
+    context->splices[context->splice_count].statement_count = statement_count;
+    context->splice_count++;
+    return TRUE;
+}
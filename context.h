@@ -0,0 +1,55 @@
+/* context.h - state of one assembly */
+#ifndef CONTEXT_H
+#define CONTEXT_H
+
+#include "types.h"
+#include "arena.h"
+#include "symbol_table.h"
+
+struct AsmMacroLibrary; /* macro_library.h */
+
+/* A macro body line the pre-assembler parsed (and, for instructions,
+   validated) once; the first pass copies it at every call instead of
+   parsing the line again */
+typedef struct
+{
+    size_t offset;            /* start of the line in the body */
+    const ParsedLine *parsed; /* in the context arena */
+} MacroStatement;
+
+/* One macro call in the expanded source and the statements of its body */
+typedef struct
+{
+    size_t offset; /* where the body starts in the expanded source */
+    const MacroStatement *statements;
+    int statement_count;
+} MacroSplice;
+
+/* Everything that belongs to one input file. The library entry points
+   in asm.c own one and pass it explicitly to every phase, so files never see each
+   other's symbols and several can be assembled at once. */
+typedef struct
+{
+    SymbolTable symbols;
+    MemoryImage memory;
+    ExtRef *ext_list;      /* external references, filled by the second pass */
+    EntryPoint *entry_list; /* .entry symbols, filled by the second pass */
+    int error_count;       /* diagnostics reported for this file */
+    int max_errors;        /* stop the first pass after this many errors, 0 = no limit */
+    long lines_read;       /* source lines read by the pre-assembler (AsmStats) */
+    long macros_expanded;  /* macro calls expanded by the pre-assembler (AsmStats) */
+    int labels_defined;    /* labels the pre-assembler saw; the first pass sizes the symbol table by it */
+    MacroSplice *splices;  /* expanded calls with pre-parsed statements, in source order */
+    int splice_count;
+    int splice_capacity;
+    const struct AsmMacroLibrary *macro_library; /* --macro-lib, or NULL; shared and read-only */
+    Arena arena;           /* file names, symbols, macros and lists; released with the context */
+} AssemblerContext;
+
+void init_assembler_context(AssemblerContext *context);
+void reset_assembler_context(AssemblerContext *context);
+void free_assembler_context(AssemblerContext *context);
+Boolean add_macro_splice(AssemblerContext *context, size_t offset,
+                         const MacroStatement *statements, int statement_count);
+
+#endif /* CONTEXT_H */
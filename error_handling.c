@@ -1,4 +1,5 @@
 #include "preassembler.h"
+#include "console.h"
 
 
 /* Print error message */
@@ -6,62 +7,62 @@ void print_error(ErrorType error, int line_number, const char *message) {
     /* Print base error message with line number if available */
     if (line_number > 0)
     {
-        fprintf(stderr, "Error on line %d: ", line_number);
+        console_err("Error on line %d: ", line_number);
     }
     else
     {
-        fprintf(stderr, "Error: ");
+        console_err("Error: ");
     }
 
     /* Print specific error type */
     switch (error)
     {
     case LINE_TOO_LONG:
-        fprintf(stderr, "Line is too long");
+        console_err("Line is too long");
         break;
     case INVALID_MACRO_NAME:
-        fprintf(stderr, "Invalid macro name");
+        console_err("Invalid macro name");
         break;
     case LABEL_ON_MACRO_LINE:
-        fprintf(stderr, "Label not allowed on macro definition line");
+        console_err("Label not allowed on macro definition line");
         break;
     case EXTRANEOUS_TEXT:
-        fprintf(stderr, "Extraneous text");
+        console_err("Extraneous text");
         break;
     case MEMORY_ALLOCATION_ERROR:
-        fprintf(stderr, "Memory allocation failed");
+        console_err("Memory allocation failed");
         break;
     case FILE_ERROR:
-        fprintf(stderr, "File error");
+        console_err("File error");
         break;
     case MACRO_NOT_CLOSED:
-        fprintf(stderr, "Macro definition not properly closed");
+        console_err("Macro definition not properly closed");
         break;
     case DUPLICATE_MACRO_NAME:
-        fprintf(stderr, "Macro name already defined");
+        console_err("Macro name already defined");
         break;
     case INVALID_LABEL_NAME:
-        fprintf(stderr, "Invalid label name");
+        console_err("Invalid label name");
         break;
     case RESERVED_WORD:
-        fprintf(stderr, "Reserved word used");
+        console_err("Reserved word used");
         break;
     case DUPLICATE_LABEL_NAME:
-        fprintf(stderr, "Label name already defined");
+        console_err("Label name already defined");
         break;
     case SYNTAX_ERROR:
-        fprintf(stderr, "Syntax error");
+        console_err("Syntax error");
         break;
     default:
-        fprintf(stderr, "Unknown error");
+        console_err("Unknown error");
         break;
     }
 
     /* Add additional message if provided */
     if (message && *message)
     {
-        fprintf(stderr, " - %s", message);
+        console_err(" - %s", message);
     }
 
-    fprintf(stderr, "\n");
+    console_err("\n");
 }
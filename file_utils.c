@@ -17,15 +17,15 @@ Boolean file_exists(const char *filename) {
     return FALSE;
 }
 
-/* Create a filename with given extension */
-char* create_filename_with_extension(const char *filename, const char *extension) {
+/* Create a filename with given extension (allocated in arena) */
+char* create_filename_with_extension(Arena *arena, const char *filename, const char *extension) {
     char *new_filename;
     
     if (!filename || !extension) {
         return NULL;
     }
     
-    new_filename = malloc(strlen(filename) + strlen(extension) + 1);
+    new_filename = arena_alloc(arena, strlen(filename) + strlen(extension) + 1);
     if (!new_filename) {
         return NULL;
     }
@@ -35,18 +35,3 @@ char* create_filename_with_extension(const char *filename, const char *extension
     
     return new_filename;
 }
-
-/* Cleanup function for error situations */
-void cleanup_and_exit(MacroTable *table, FILE *input, FILE *output) {
-    if (table) {
-        free_macro_table(table);
-    }
-    
-    if (input) {
-        fclose(input);
-    }
-    
-    if (output) {
-        fclose(output);
-    }
-}
\ No newline at end of file
@@ -16,6 +16,10 @@
 #include "line_analysis.h"
 #include "symbol_table.h"
 #include "instruction_validation.h"
+#include "line_parser.h"
+#include "text_buffer.h"
+#include "context.h"
+#include "console.h"
 #include <stdarg.h> 
 
 /**
@@ -24,194 +28,234 @@
  * @param format Printf-style format string
  * @param ... Variable arguments for format string
  */
-void error(int line_number, const char *format, ...)
+static void error(int line_number, const char *format, ...)
 {
     va_list args;
     va_start(args, format);
 
     if (line_number > 0)
     {
-        fprintf(stderr, "Error on line %d: ", line_number);
+        console_err("Error on line %d: ", line_number);
     }
     else
     {
-        fprintf(stderr, "Error: ");
+        console_err("Error: ");
     }
 
-    vfprintf(stderr, format, args);
-    fprintf(stderr, "\n");
+    vconsole_err(format, args);
+    console_err("\n");
     va_end(args);
 }
 
 /**
  * @brief Adjust data symbol addresses by adding ICF (final instruction counter)
+ * @param symbols Symbol table of the file
  * @param icf Final instruction counter value
  * 
  * This function is called after the first pass to adjust all data symbol
  * addresses by adding the final instruction counter value, ensuring proper
  * memory layout where data follows instructions.
  */
-static void adjust_data_addresses_with_icf(int icf) {
+static void adjust_data_addresses_with_icf(SymbolTable *symbols, int icf) {
     Symbol *s;
-    for (s = symbol_table_head; s; s = s->next) {
+    for (s = symbols->head; s; s = s->next) {
         if (s->type == DATA) {
             s->address += icf;
         }
     }
 }
 
+/**
+ * @brief Find the pre-parsed macro statement for the line at position
+ * @param ctx Assembly context holding the expanded macro calls
+ * @param position Offset of the line in the expanded source
+ * @param splice Cursor over ctx->splices, advanced past earlier calls
+ * @param statement Cursor over the statements of that call
+ * @return The statement, or NULL if the line has to be parsed
+ *
+ * Lines are visited in order, so both cursors only move forward.
+ */
+static const ParsedLine *next_macro_statement(const AssemblerContext *ctx, size_t position,
+                                              int *splice, int *statement)
+{
+    while (*splice < ctx->splice_count) {
+        const MacroSplice *call = &ctx->splices[*splice];
+
+        if (*statement < call->statement_count) {
+            size_t start = call->offset + call->statements[*statement].offset;
+
+            if (start > position)
+                return NULL;
+            if (start == position)
+                return call->statements[(*statement)++].parsed;
+            (*statement)++;
+            continue;
+        }
+
+        (*splice)++;
+        *statement = 0;
+    }
+
+    return NULL;
+}
+
 /**
  * @brief Main first pass function - analyzes source file and builds symbol table
- * @param filename Name of the .am file to process
+ * @param ctx Assembly context; receives the symbols and the error count
+ * @param source Macro-expanded source produced by the pre-assembler
+ * @param program Receives one parsed record per statement, for the later phases
+ * @return TRUE if the source has no errors
  * 
  * The first pass performs the following operations:
- * 1. Reads and parses each line of the source file
+ * 1. Reads and parses each line of the expanded source
  * 2. Identifies and validates labels, instructions, and directives
  * 3. Builds the symbol table with appropriate addresses
  * 4. Counts instructions and data for memory allocation
  * 5. Reports syntax errors and validation issues
+ *
+ * Each statement is parsed once into program; the memory builder and
+ * the second pass work from those records instead of the file.
+ * Macro body statements the pre-assembler already parsed and validated
+ * (ctx->splices) are copied rather than parsed again at every call.
+ * With --max-errors N the scan stops once N statements were rejected.
  */
-void first_pass(const char *filename) {
+Boolean first_pass(AssemblerContext *ctx, const TextBuffer *source, ParsedProgram *program) {
     char line[MAX_LINE_LENGTH];
+    LineSpan span;
+    size_t position = 0;
     int line_number = 0;
     int IC = 100;   /* Instruction Counter */
     int DC = 0;  /* Data Counter */
     int ICF = 0;     
-    int has_errors = 0;
-
-    FILE *inputFile = fopen(filename, "r");
-    if (!inputFile) {
-        perror("Error opening input file");
-        return;
-    }
+    int errors = 0;
+    int max_errors = ctx->max_errors;
+    int splice = 0;    /* macro call in ctx->splices the scan has reached */
+    int statement = 0; /* next pre-parsed statement of that call */
 
-    printf("Opened file '%s' successfully!\n", filename);
+    log_verbose(("Starting first pass...\n"));
 
-    printf("Starting first pass...\n");
+    /* one index allocation for the labels the pre-assembler counted */
+    reserve_symbol_table(&ctx->symbols, ctx->labels_defined);
 
-    while (fgets(line, sizeof(line), inputFile)) {
-        char label[MAX_LABEL_LENGTH] = "";
-        int has_label = 0;
+    while ((max_errors == 0 || errors < max_errors) &&
+           next_line_span(source, &position, &span)) {
+        ParsedLine *parsed;
+        const char *label;
         const char *line_for_validation = NULL;
+        const ParsedLine *prepared;
         int words = 0;
         Symbol *existing; 
 
         line_number++;
 
+        /* the pre-assembler checked the source lines, but a label in front
+           of a macro call can make an expanded line longer than the buffer;
+           it is read in buffer-sized pieces */
+        split_line_span(source, &position, &span, sizeof(line));
+        copy_line_span(&span, line);
+
+        /* a macro body line the pre-assembler already parsed and validated */
+        prepared = next_macro_statement(ctx, (size_t)(span.text - source->data), &splice, &statement);
+
         if (is_comment_or_empty(line)) {
             continue;
         }
 
-        printf("Line %d: %s", line_number, line);
+        log_debug(("Line %d: %s", line_number, line));
 
+        parsed = add_parsed_line(program);
+        if (!parsed) {
+            error(line_number, "Memory allocation failed for parsed line");
+            errors++;
+            break;
+        }
+        if (prepared) {
+            *parsed = *prepared;
+            parsed->line_number = line_number;
+        } else {
+            parse_source_line(line, line_number, parsed);
+        }
+        label = parsed->label;
 
-        has_label = extract_label(line, label);
-        if (has_label) {
-            printf("  -> Label found!!!!: %s\n", label);
-            /*printf("[DBG] label='%s' first=%d '%c'\n",
-       label, (unsigned char)label[0], label[0]);*/
-
+        if (parsed->has_label) {
+            log_debug(("  -> Label found!!!!: %s\n", label));
 
             if (!is_valid_label(label)) {
-                printf("  !!!!!");
+                log_debug(("  !!!!!"));
                 error(line_number, "Invalid label name: %s", label);
-                has_errors = 1;
+                errors++;
                 continue;
             }
 
-            existing = find_symbol(label);
+            existing = find_symbol(&ctx->symbols, label);
             if (existing) {
                 if (existing->type == EXTERN_SYM) {
                     error(line_number, "Label '%s' declared extern earlier", label);
-                    has_errors = 1;
+                    errors++;
                     continue;
                 }
                 if (existing->address != 0) {
                     error(line_number, "Duplicate label: %s", label);
-                    has_errors = 1;
+                    errors++;
                     continue;
                 }
             }
         }
 
-        /* ===== .entry ===== */
-        if (strstr(line, ".entry")) {
-            char entry_label[MAX_LABEL_LENGTH];
-            if (sscanf(line, "%*s %30s", entry_label) == 1) {
-                if (!add_symbol_to_table(entry_label, 0, CODE, line_number, 1)) {
-                    has_errors = 1;
+        /* ===== .entry / .extern ===== */
+        if (parsed->kind == LINE_ENTRY || parsed->kind == LINE_EXTERN) {
+            int is_entry = (parsed->kind == LINE_ENTRY);
+            char symbol_name[MAX_LABEL_LENGTH];
+            int length = parsed->operands[0].length;
+
+            if (parsed->operand_count == 1) {
+                if (length > MAX_LABEL_LENGTH - 1)
+                    length = MAX_LABEL_LENGTH - 1;
+                strncpy(symbol_name, parsed->text + parsed->operands[0].start, length);
+                symbol_name[length] = '\0';
+                if (!add_symbol_to_table(&ctx->symbols, symbol_name, 0, is_entry ? CODE : EXTERN_SYM,
+                                         line_number, is_entry)) {
+                    errors++;
                 }
             } else {
-                error(line_number, "Invalid .entry directive");
-                has_errors = 1;
-            }
-            continue;
-        }
-
-        /* ===== .extern ===== */
-        if (strstr(line, ".extern")) {
-            char extern_label[MAX_LABEL_LENGTH];
-            if (sscanf(line, "%*s %30s", extern_label) == 1) {
-                if (!add_symbol_to_table(extern_label, 0, EXTERN_SYM, line_number, 0)) {
-                    has_errors = 1;
-                }
-            } else {
-                error(line_number, "Invalid .extern directive");
-                has_errors = 1;
+                error(line_number, is_entry ? "Invalid .entry directive" : "Invalid .extern directive");
+                errors++;
             }
             continue;
         }
 
         /* ===== Data ===== */
-        if (is_data_or_string(line)) {
-            printf("  -> This line is a data or string directive.\n");
+        if (parsed->kind == LINE_DATA || parsed->kind == LINE_STRING || parsed->kind == LINE_MATRIX) {
+            log_debug(("  -> This line is a data or string directive.\n"));
 
-            if (has_label) {
-                if (!add_symbol_to_table(label, DC, DATA, line_number, 0)) {
-                    has_errors = 1;
+            if (parsed->has_label) {
+                if (!add_symbol_to_table(&ctx->symbols, label, DC, DATA, line_number, 0)) {
+                    errors++;
                     continue;
                 }
             }
 
-            if (strstr(line, ".data")) {
-                int count = count_data_items(line);
-printf("DEBUG: .data line '%s' counted %d items, DC before: %d\n", line, count, DC);
-DC += count;
-printf("DEBUG: DC after: %d\n", DC);
-                if (IC + DC > 256) {
-                    printf("Error line %d: Memory overflow - total program size exceeds 256 words\n", line_number);
-                    has_errors = 1;}
-            } else if (strstr(line, ".string")) {
-                int count = count_string_length(line);
-printf("DEBUG: .string line '%s' counted %d chars, DC before: %d\n", line, count, DC);
-DC += count;
-printf("DEBUG: DC after: %d\n", DC);
-                if (IC + DC > 256) {
-                    printf("Error line %d: Memory overflow - total program size exceeds 256 words\n", line_number);
-                    has_errors = 1;}
-            } else if (strstr(line, ".mat")) {
-                int count = count_matrix_items(line);
-printf("DEBUG: .mat line '%s' counted %d items, DC before: %d\n", line, count, DC);
-DC += count;
-printf("DEBUG: DC after: %d\n", DC);
-                if (IC + DC > 256) {
-                    printf("Error line %d: Memory overflow - total program size exceeds 256 words\n", line_number);
-                    has_errors = 1;}
+            log_debug(("DEBUG: data line '%s' counted %d words, DC before: %d\n", parsed->text, parsed->word_count, DC));
+            DC += parsed->word_count;
+            log_debug(("DEBUG: DC after: %d\n", DC));
+            if (IC + DC > 256) {
+                console_out("Error line %d: Memory overflow - total program size exceeds 256 words\n", line_number);
+                errors++;
             }
         }
         /* ===== inst code ===== */
-        else if (is_command(line)) {
-            printf("  -> This line is a command.\n");
+        else if (parsed->kind == LINE_INSTRUCTION) {
+            log_debug(("  -> This line is a command.\n"));
 
-            if (has_label) {
-                if (!add_symbol_to_table(label, IC, CODE, line_number, 0)) {
-                    has_errors = 1;
+            if (parsed->has_label) {
+                if (!add_symbol_to_table(&ctx->symbols, label, IC, CODE, line_number, 0)) {
+                    errors++;
                     continue;
                 }
             }
 
             line_for_validation = line;
-            if (has_label) {
+            if (parsed->has_label) {
                 const char *colon = strchr(line, ':');
                 if (colon) {
                     line_for_validation = colon + 1;
@@ -220,43 +264,49 @@ printf("DEBUG: DC after: %d\n", DC);
                 }
             }
 
-           
-            words = count_command_words(has_label ? line_for_validation : line);
-            printf("DEBUG first_pass: instruction '%s' counts as %d words, IC before: %d\n", 
-       has_label ? line_for_validation : line, words, IC);
-            if (!validate_command_line(line_for_validation, line_number)) {
-                has_errors = 1;
+            words = parsed->word_count;
+            log_debug(("DEBUG first_pass: instruction '%s' counts as %d words, IC before: %d\n", 
+       line_for_validation, words, IC));
+            if (!prepared && !validate_command_line(line_for_validation, line_number)) {
+                errors++;
                 IC += words; 
                     
                 continue;
             }
 
             IC += words;
-            printf("DEBUG first_pass: IC after: %d\n", IC);
+            log_debug(("DEBUG first_pass: IC after: %d\n", IC));
             if (IC > 255) {
-                printf("Error line %d: Memory overflow - instruction area exceeds available memory\n", line_number);
-                has_errors = 1;
+                console_out("Error line %d: Memory overflow - instruction area exceeds available memory\n", line_number);
+                errors++;
                 }
 
         }else {
-            has_errors= 1;
+            error(line_number, "Unknown instruction or directive: %s", parsed->text);
+            errors++;
         }
 
         
     }
 
     ICF = IC; /* Instruction Counter Final */
-    adjust_data_addresses_with_icf(ICF);
+    adjust_data_addresses_with_icf(&ctx->symbols, ICF);
 
-    printf("First pass completed.\n");
-    if (has_errors) {
-        printf("Errors found during first pass.\n");
+    log_verbose(("First pass completed.\n"));
+    if (max_errors > 0 && errors >= max_errors) {
+        console_out("Stopped after %d errors (--max-errors).\n", errors);
+    }
+    if (errors) {
+        console_out("Errors found during first pass: %d\n", errors);
     } else {
-        printf("No errors found in first pass.\n");
+        log_verbose(("No errors found in first pass.\n"));
     }
-    printf("Final IC = %d (ICF)\n", IC);
-    printf("Final DC = %d\n", DC);
+    log_verbose(("Final IC = %d (ICF)\n", IC));
+    log_verbose(("Final DC = %d\n", DC));
+
 
+       print_symbol_table(&ctx->symbols);
 
-       print_symbol_table();
+    ctx->error_count += errors;
+    return errors == 0 ? TRUE : FALSE;
 }
@@ -3,10 +3,10 @@
 #define FIRST_PASS_H
 
 #include "types.h"
+#include "context.h"
 #include <stdarg.h>
 
 /* first pass functions */
-void first_pass(const char *filename);
-void error(int line_number, const char *format, ...);
+Boolean first_pass(AssemblerContext *ctx, const TextBuffer *source, ParsedProgram *program);
 
 #endif /* FIRST_PASS_H */
@@ -0,0 +1,33 @@
+/* hash_utils.c - string hashing shared by the lookup tables */
+#include "hash_utils.h"
+
+#define FNV_PRIME 16777619UL
+
+/* hash the first length characters of str (FNV-1a, 32 bit) */
+unsigned long hash_string(const char *str, int length)
+{
+    unsigned long hash = HASH_INITIAL;
+    int i;
+
+    for (i = 0; i < length; i++)
+    {
+        hash ^= (unsigned char)str[i];
+        hash = (hash * FNV_PRIME) & 0xFFFFFFFFUL;
+    }
+
+    return hash;
+}
+
+/* continue an FNV-1a hash over length more bytes */
+unsigned long hash_bytes(unsigned long hash, const char *data, size_t length)
+{
+    size_t i;
+
+    for (i = 0; i < length; i++)
+    {
+        hash ^= (unsigned char)data[i];
+        hash = (hash * FNV_PRIME) & 0xFFFFFFFFUL;
+    }
+
+    return hash;
+}
@@ -0,0 +1,15 @@
+/* hash_utils.h - string hashing shared by the lookup tables */
+#ifndef HASH_UTILS_H
+#define HASH_UTILS_H
+
+#include <stddef.h>
+
+#define HASH_INITIAL 2166136261UL /* FNV offset basis: start value for hash_bytes */
+
+/* hash the first length characters of str (FNV-1a, 32 bit) */
+unsigned long hash_string(const char *str, int length);
+
+/* continue an FNV-1a hash over length more bytes, e.g. to hash several buffers */
+unsigned long hash_bytes(unsigned long hash, const char *data, size_t length);
+
+#endif /* HASH_UTILS_H */
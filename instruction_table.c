@@ -4,44 +4,113 @@
 #include <stdlib.h>
 #include <string.h>
 
-/* static instruction table */
+#define MODES_SYMBOL (MODE_BIT(DIRECT_ADDR) | MODE_BIT(MATRIX_ADDR))
+
+/* static instruction table: name, opcode, operands, source modes, destination modes */
 static InstructionDef instructions[] = {
-    {"mov", 0, 2},
-    {"cmp", 1, 2},
-    {"add", 2, 2},
-    {"sub", 3, 2},
-    {"lea", 4, 2},
-    {"clr", 5, 1},
-    {"not", 6, 1},
-    {"inc", 7, 1},
-    {"dec", 8, 1},
-    {"jmp", 9, 1},
-    {"bne", 10, 1},
-    {"jsr", 11, 1},
-    {"red", 12, 1},
-    {"prn", 13, 1},
-    {"rts", 14, 0},
-    {"stop", 15, 0}};
+    {"mov", 0, 2, MODES_ANY, MODES_NOT_IMMEDIATE},
+    {"cmp", 1, 2, MODES_ANY, MODES_ANY},
+    {"add", 2, 2, MODES_ANY, MODES_NOT_IMMEDIATE},
+    {"sub", 3, 2, MODES_ANY, MODES_NOT_IMMEDIATE},
+    {"lea", 4, 2, MODES_SYMBOL, MODE_BIT(DIRECT_ADDR) | MODE_BIT(REGISTER_ADDR)},
+    {"clr", 5, 1, MODES_NONE, MODES_NOT_IMMEDIATE},
+    {"not", 6, 1, MODES_NONE, MODES_NOT_IMMEDIATE},
+    {"inc", 7, 1, MODES_NONE, MODES_NOT_IMMEDIATE},
+    {"dec", 8, 1, MODES_NONE, MODES_NOT_IMMEDIATE},
+    {"jmp", 9, 1, MODES_NONE, MODES_SYMBOL},
+    {"bne", 10, 1, MODES_NONE, MODES_SYMBOL},
+    {"jsr", 11, 1, MODES_NONE, MODES_SYMBOL},
+    {"red", 12, 1, MODES_NONE, MODES_NOT_IMMEDIATE},
+    {"prn", 13, 1, MODES_NONE, MODES_ANY},
+    {"rts", 14, 0, MODES_NONE, MODES_NONE},
+    {"stop", 15, 0, MODES_NONE, MODES_NONE}};
 
 #define INSTRUCTION_COUNT 16
 
+/* every reserved word: instructions, directives, registers and macro keywords */
+static const Keyword keywords[] = {
+    {"mov", 3, KEYWORD_INSTRUCTION, OP_MOV, &instructions[OP_MOV]},
+    {"cmp", 3, KEYWORD_INSTRUCTION, OP_CMP, &instructions[OP_CMP]},
+    {"add", 3, KEYWORD_INSTRUCTION, OP_ADD, &instructions[OP_ADD]},
+    {"sub", 3, KEYWORD_INSTRUCTION, OP_SUB, &instructions[OP_SUB]},
+    {"lea", 3, KEYWORD_INSTRUCTION, OP_LEA, &instructions[OP_LEA]},
+    {"clr", 3, KEYWORD_INSTRUCTION, OP_CLR, &instructions[OP_CLR]},
+    {"not", 3, KEYWORD_INSTRUCTION, OP_NOT, &instructions[OP_NOT]},
+    {"inc", 3, KEYWORD_INSTRUCTION, OP_INC, &instructions[OP_INC]},
+    {"dec", 3, KEYWORD_INSTRUCTION, OP_DEC, &instructions[OP_DEC]},
+    {"jmp", 3, KEYWORD_INSTRUCTION, OP_JMP, &instructions[OP_JMP]},
+    {"bne", 3, KEYWORD_INSTRUCTION, OP_BNE, &instructions[OP_BNE]},
+    {"jsr", 3, KEYWORD_INSTRUCTION, OP_JSR, &instructions[OP_JSR]},
+    {"red", 3, KEYWORD_INSTRUCTION, OP_RED, &instructions[OP_RED]},
+    {"prn", 3, KEYWORD_INSTRUCTION, OP_PRN, &instructions[OP_PRN]},
+    {"rts", 3, KEYWORD_INSTRUCTION, OP_RTS, &instructions[OP_RTS]},
+    {"stop", 4, KEYWORD_INSTRUCTION, OP_STOP, &instructions[OP_STOP]},
+    {".data", 5, KEYWORD_DIRECTIVE, DIR_DATA, NULL},
+    {".string", 7, KEYWORD_DIRECTIVE, DIR_STRING, NULL},
+    {".mat", 4, KEYWORD_DIRECTIVE, DIR_MAT, NULL},
+    {".entry", 6, KEYWORD_DIRECTIVE, DIR_ENTRY, NULL},
+    {".extern", 7, KEYWORD_DIRECTIVE, DIR_EXTERN, NULL},
+    {"r0", 2, KEYWORD_REGISTER, 0, NULL},
+    {"r1", 2, KEYWORD_REGISTER, 1, NULL},
+    {"r2", 2, KEYWORD_REGISTER, 2, NULL},
+    {"r3", 2, KEYWORD_REGISTER, 3, NULL},
+    {"r4", 2, KEYWORD_REGISTER, 4, NULL},
+    {"r5", 2, KEYWORD_REGISTER, 5, NULL},
+    {"r6", 2, KEYWORD_REGISTER, 6, NULL},
+    {"r7", 2, KEYWORD_REGISTER, 7, NULL},
+    {"mcro", 4, KEYWORD_MACRO_START, 0, NULL},
+    {"mcroend", 7, KEYWORD_MACRO_END, 0, NULL}};
+
+/*
+ * Perfect hash over the keywords above: KEYWORD_HASH maps each keyword
+ * to a distinct slot. keyword_slots gives the keyword index for every
+ * slot (-1 when empty), so a lookup is one hash and one compare.
+ * `make check-keywords` (tests/bench/keyword_hash.c) checks both against
+ * the keyword list, and prints new ones when the list has changed.
+ */
+#define KEYWORD_SLOTS 64
+#define KEYWORD_HASH(w, length) \
+    (((w)[0] + 10 * (w)[1] + 9 * (w)[(length) - 1] + 6 * (length)) % KEYWORD_SLOTS)
+
+static const signed char keyword_slots[KEYWORD_SLOTS] = {
+    27, -1, 7, 15, -1, 19, -1, 24, -1, 3, 29, -1, -1, 10, 21, -1,
+    -1, -1, -1, 28, 13, -1, -1, 14, -1, 4, 25, -1, 18, 16, -1, 2,
+    -1, 22, -1, 8, -1, -1, -1, 1, 20, -1, 6, -1, -1, 26, 9, 5,
+    -1, -1, -1, -1, 23, 17, -1, -1, -1, 30, 12, 0, 11, -1, -1, -1};
+
+/* find a reserved word given as a (not necessarily terminated) span */
+const Keyword *find_keyword(const char *word, int length)
+{
+    const unsigned char *w = (const unsigned char *)word;
+    const Keyword *keyword;
+    int index;
+
+    if (!word || length < 2 || length > 7)
+        return NULL;
+
+    index = keyword_slots[KEYWORD_HASH(w, length)];
+    if (index < 0)
+        return NULL;
+
+    keyword = &keywords[index];
+    if (keyword->length != length || memcmp(keyword->name, word, length) != 0)
+        return NULL;
+    return keyword;
+}
+
 /* find instruction by name */
 InstructionDef *find_instruction(const char *name)
 {
-    int i;
+    const Keyword *keyword;
 
     if (!name)
         return NULL;
 
-    for (i = 0; i < INSTRUCTION_COUNT; i++)
-    {
-        if (strcmp(instructions[i].name, name) == 0)
-        {
-            return &instructions[i];
-        }
-    }
+    keyword = find_keyword(name, strlen(name));
+    if (!keyword || keyword->kind != KEYWORD_INSTRUCTION)
+        return NULL;
 
-    return NULL;
+    return keyword->instruction;
 }
 
 /* check if instruction is valid */
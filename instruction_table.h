@@ -4,6 +4,60 @@
 
 #include "types.h"
 
+/* opcodes, in instruction table order */
+typedef enum
+{
+    OP_MOV,
+    OP_CMP,
+    OP_ADD,
+    OP_SUB,
+    OP_LEA,
+    OP_CLR,
+    OP_NOT,
+    OP_INC,
+    OP_DEC,
+    OP_JMP,
+    OP_BNE,
+    OP_JSR,
+    OP_RED,
+    OP_PRN,
+    OP_RTS,
+    OP_STOP
+} Opcode;
+
+/* directive ids */
+typedef enum
+{
+    DIR_DATA,
+    DIR_STRING,
+    DIR_MAT,
+    DIR_ENTRY,
+    DIR_EXTERN
+} DirectiveId;
+
+/* kinds of reserved words */
+typedef enum
+{
+    KEYWORD_INSTRUCTION,
+    KEYWORD_DIRECTIVE,
+    KEYWORD_REGISTER,
+    KEYWORD_MACRO_START,
+    KEYWORD_MACRO_END
+} KeywordKind;
+
+/* reserved word as returned by find_keyword */
+typedef struct
+{
+    const char *name;
+    int length;
+    KeywordKind kind;
+    int value;                   /* opcode, directive id or register number */
+    InstructionDef *instruction; /* operand metadata, instructions only */
+} Keyword;
+
+/* reserved word recognizer */
+const Keyword *find_keyword(const char *word, int length);
+
 /* instruction table functions */
 InstructionDef *find_instruction(const char *name);
 Boolean is_valid_instruction(const char *name);
@@ -6,6 +6,7 @@
 #include "instruction_table.h"
 #include "line_analysis.h"
 #include "symbol_table.h"
+#include "console.h"
 
 /* operand types */
 typedef enum
@@ -92,7 +93,7 @@ static int validate_operands_count(const InstructionDef *instr,
     {
         if (!op1 || !*op1)
         {
-            printf("Error on line %d: Missing operand for instruction '%s'.\n",
+            console_out("Error on line %d: Missing operand for instruction '%s'.\n",
                    line_number, instr->name);
             return 0;
         }
@@ -103,14 +104,14 @@ static int validate_operands_count(const InstructionDef *instr,
     {
         if (!op1 || !*op1 || !op2 || !*op2)
         {
-            printf("Error on line %d: Missing operands for instruction '%s'.\n",
+            console_out("Error on line %d: Missing operands for instruction '%s'.\n",
                    line_number, instr->name);
             return 0;
         }
         return 1;
     }
 
-    printf("Error on line %d: Internal: unsupported operands_count=%d for '%s'.\n",
+    console_out("Error on line %d: Internal: unsupported operands_count=%d for '%s'.\n",
            line_number, instr->operands_count, instr->name);
     return 0;
 }
@@ -118,11 +119,8 @@ static int validate_operands_count(const InstructionDef *instr,
 /* check whether operand types are allowed for the instruction */
 static int is_type_allowed_for_instruction(const InstructionDef *ins,
                                            OperandType srcType,
-                                           OperandType dstType,
-                                           int line_number)
+                                           OperandType dstType)
 {
-    const char *name = ins->name;
-
     if (ins->operands_count == 0)
         return 1;
     if (ins->operands_count >= 1 && dstType == OT_INVALID)
@@ -130,50 +128,11 @@ static int is_type_allowed_for_instruction(const InstructionDef *ins,
     if (ins->operands_count == 2 && srcType == OT_INVALID)
         return 0;
 
-    if (!strcmp(name, "cmp"))
-    {
-        return 1; /* cmp accepts any operand type */
-    }
+    /* operand types share their values with the addressing modes */
+    if (ins->operands_count == 1)
+        return (ins->dst_modes & MODE_BIT(dstType)) != 0;
 
-    if (!strcmp(name, "mov") || !strcmp(name, "add") || !strcmp(name, "sub"))
-    {
-        return (dstType != OT_IMMEDIATE); /* destination cannot be immediate */
-    }
-
-    if (!strcmp(name, "lea"))
-    {
-        int src_ok = (srcType == OT_DIRECT || srcType == OT_MATRIX);
-        int dst_ok = (dstType == OT_DIRECT || dstType == OT_REGISTER);
-        return src_ok && dst_ok;
-    }
-
-    if (!strcmp(name, "not") || !strcmp(name, "clr") ||
-        !strcmp(name, "inc") || !strcmp(name, "dec"))
-    {
-        return (dstType == OT_DIRECT || dstType == OT_MATRIX || dstType == OT_REGISTER);
-    }
-
-    if (!strcmp(name, "red"))
-    {
-        return (dstType == OT_DIRECT || dstType == OT_MATRIX || dstType == OT_REGISTER);
-    }
-
-    if (!strcmp(name, "prn"))
-    {
-        return 1; /* prn accepts any operand type */
-    }
-
-    if (!strcmp(name, "jmp") || !strcmp(name, "bne") || !strcmp(name, "jsr"))
-    {
-        return (dstType == OT_DIRECT || dstType == OT_MATRIX);
-    }
-
-    if (!strcmp(name, "rts") || !strcmp(name, "stop"))
-    {
-        return 1; /* no operands */
-    }
-
-    return 0;
+    return (ins->src_modes & MODE_BIT(srcType)) && (ins->dst_modes & MODE_BIT(dstType));
 }
 
 /* validate operand types */
@@ -189,19 +148,19 @@ static int validate_operands_types(const InstructionDef *instr,
         OperandType t = classify_operand(op1);
         if (t == OT_INVALID)
         {
-            printf("Error on line %d: Invalid operand '%s'.\n", line_number, op1);
+            console_out("Error on line %d: Invalid operand '%s'.\n", line_number, op1);
             return 0;
         }
-        if (!is_type_allowed_for_instruction(instr, OT_INVALID, t, line_number))
+        if (!is_type_allowed_for_instruction(instr, OT_INVALID, t))
         {
-            if (!strcmp(instr->name, "prn"))
+            if (instr->opcode == OP_PRN)
             {
-                printf("Error on line %d: Operand type not allowed for '%s'.\n",
+                console_out("Error on line %d: Operand type not allowed for '%s'.\n",
                        line_number, instr->name);
             }
             else
             {
-                printf("Error on line %d: Operand for '%s' must be direct/matrix/register (not immediate).\n",
+                console_out("Error on line %d: Operand for '%s' must be direct/matrix/register (not immediate).\n",
                        line_number, instr->name);
             }
             return 0;
@@ -215,46 +174,46 @@ static int validate_operands_types(const InstructionDef *instr,
         OperandType t2 = classify_operand(op2);
         if (t1 == OT_INVALID)
         {
-            printf("Error on line %d: Invalid source operand '%s'.\n",
+            console_out("Error on line %d: Invalid source operand '%s'.\n",
                    line_number, op1);
             return 0;
         }
         if (t2 == OT_INVALID)
         {
-            printf("Error on line %d: Invalid destination operand '%s'.\n",
+            console_out("Error on line %d: Invalid destination operand '%s'.\n",
                    line_number, op2);
             return 0;
         }
 
-        if (!is_type_allowed_for_instruction(instr, t1, t2, line_number))
+        if (!is_type_allowed_for_instruction(instr, t1, t2))
         {
-            if (!strcmp(instr->name, "lea"))
+            if (instr->opcode == OP_LEA)
             {
                 if (!(t1 == OT_DIRECT || t1 == OT_MATRIX))
                 {
-                    printf("Error on line %d: Source for 'lea' must be direct/matrix.\n", line_number);
+                    console_out("Error on line %d: Source for 'lea' must be direct/matrix.\n", line_number);
                 }
                 else
                 {
-                    printf("Error on line %d: Destination for 'lea' must be direct/register.\n", line_number);
+                    console_out("Error on line %d: Destination for 'lea' must be direct/register.\n", line_number);
                 }
             }
-            else if (!strcmp(instr->name, "mov") || !strcmp(instr->name, "add") || !strcmp(instr->name, "sub"))
+            else if (instr->opcode == OP_MOV || instr->opcode == OP_ADD || instr->opcode == OP_SUB)
             {
                 if (t2 == OT_IMMEDIATE)
                 {
-                    printf("Error on line %d: Destination cannot be immediate for '%s'.\n",
+                    console_out("Error on line %d: Destination cannot be immediate for '%s'.\n",
                            line_number, instr->name);
                 }
                 else
                 {
-                    printf("Error on line %d: Operand types not allowed for '%s'.\n",
+                    console_out("Error on line %d: Operand types not allowed for '%s'.\n",
                            line_number, instr->name);
                 }
             }
             else
             {
-                printf("Error on line %d: Operand types not allowed for '%s'.\n",
+                console_out("Error on line %d: Operand types not allowed for '%s'.\n",
                        line_number, instr->name);
             }
             return 0;
@@ -277,13 +236,13 @@ int validate_command_line(const char *line, int line_number)
 
     if (sscanf(line, " %31s %255[^\n]", command, rest) < 1)
     {
-        printf("Error on line %d: Empty or invalid line format.\n", line_number);
+        console_out("Error on line %d: Empty or invalid line format.\n", line_number);
         return 0;
     }
 
     if (!is_lowercase_only(command))
     {
-        printf("Error on line %d: Command name must contain only lowercase letters: '%s'\n",
+        console_out("Error on line %d: Command name must contain only lowercase letters: '%s'\n",
                line_number, command);
         return 0;
     }
@@ -291,7 +250,7 @@ int validate_command_line(const char *line, int line_number)
     instr = find_instruction(command);
     if (!instr)
     {
-        printf("Error on line %d: Unknown instruction '%s'\n", line_number, command);
+        console_out("Error on line %d: Unknown instruction '%s'\n", line_number, command);
         return 0;
     }
 
@@ -299,7 +258,7 @@ int validate_command_line(const char *line, int line_number)
 
     if (count != instr->operands_count)
     {
-        printf("Error on line %d: Instruction '%s' expects %d operands, got %d.\n",
+        console_out("Error on line %d: Instruction '%s' expects %d operands, got %d.\n",
                line_number, instr->name, instr->operands_count, count);
         return 0;
     }
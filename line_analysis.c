@@ -1,5 +1,10 @@
+/* for strtok_r under -ansi */
+#define _POSIX_C_SOURCE 200112L
+
 #include "line_analysis.h"
 #include "symbol_table.h"
+#include "instruction_table.h"
+#include "console.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -38,11 +43,6 @@ Boolean is_valid_label(const char *label)
     return TRUE;
 }
 
-Boolean label_exists(const char *label)
-{
-    return find_symbol(label) ? TRUE : FALSE;
-}
-
 Boolean is_comment_or_empty(const char *line)
 {
     while (*line == ' ' || *line == '\t')
@@ -83,21 +83,13 @@ Boolean is_data_or_string(const char *line)
                : FALSE;
 }
 
-Boolean is_command(const char *line)
+/* skip leading whitespace and a "LABEL:" prefix; returns the statement start */
+const char *skip_label(const char *line)
 {
-    char op[16] = {0};
     const char *q;
-    int i;
-    const char *colon;  
-    static const char *ops[] = {
-        "mov", "cmp", "add", "sub", "lea",
-        "clr", "not", "inc", "dec",
-        "jmp", "bne", "jsr",
-        "red", "prn",
-        "rts", "stop",
-        NULL};
-
+    const char *colon;
     const char *p = line;
+
     while (*p && isspace((unsigned char)*p))
         p++;
 
@@ -121,23 +113,30 @@ Boolean is_command(const char *line)
         }
     }
 
-    sscanf(p, "%15s", op);
-    if (op[0] == '\0')
-        return FALSE;
+    return p;
+}
 
-    for (i = 0; ops[i] != NULL; i++)
-    {
-        if (strcmp(op, ops[i]) == 0)
-            return TRUE;
-    }
+Boolean is_command(const char *line)
+{
+    const Keyword *keyword;
+    const char *p = skip_label(line);
+    const char *end;
+
+    while (*p && isspace((unsigned char)*p))
+        p++;
+    end = p;
+    while (*end && !isspace((unsigned char)*end))
+        end++;
 
-    return FALSE;
+    keyword = find_keyword(p, end - p);
+    return keyword && keyword->kind == KEYWORD_INSTRUCTION;
 }
 
 int count_data_items(const char *line)
 {
     int count = 0;
     char *token;
+    char *save;
     char buffer[256];
     const char *data_start = strstr(line, ".data");
     if (!data_start)
@@ -146,7 +145,7 @@ int count_data_items(const char *line)
     data_start += strlen(".data");
     strcpy(buffer, data_start);
 
-    token = strtok(buffer, ",");
+    token = strtok_r(buffer, ",", &save);
     while (token != NULL)
     {
         while (isspace(*token))
@@ -155,7 +154,7 @@ int count_data_items(const char *line)
         {
             count++;
         }
-        token = strtok(NULL, ",");
+        token = strtok_r(NULL, ",", &save);
     }
 
     return count;
@@ -272,7 +271,7 @@ int count_string_length(const char *line)
         end++;
     
     count = end - start;
-    printf("DEBUG count_string_length: found %d ASCII chars\n", count);
+    log_debug(("DEBUG count_string_length: found %d ASCII chars\n", count));
     
     return count + 1; /* +1 for null terminator */
 }
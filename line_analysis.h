@@ -9,6 +9,7 @@ Boolean is_comment_or_empty(const char *line);
 Boolean is_label(const char *line);
 Boolean is_data_or_string(const char *line); 
 Boolean is_command(const char *line);
+const char *skip_label(const char *line);
 Boolean is_register(const char *operand);
 Boolean is_immediate(const char *operand);
 Boolean is_matrix(const char *operand);
@@ -17,7 +18,6 @@ Boolean is_label_operand(const char *operand);
 
 int extract_label(const char *line, char *label);
 Boolean is_valid_label(const char *label);
-Boolean label_exists(const char *label);
 int count_data_items(const char *line);
 int count_string_length(const char *line);
 int count_command_words(const char *line);
@@ -32,4 +32,4 @@ Boolean is_empty_line(const char *line);
 Boolean is_comment_line(const char *line);
 char *trim_whitespace(char *str);
 
-#endif /* LINE_ANALYSIS_H */
\ No newline at end of file
+#endif /* LINE_ANALYSIS_H */
\ No newline at end of file
@@ -1,21 +1,189 @@
 #include "preassembler.h"
 #include "line_analysis.h"
+#include "line_parser.h"
+#include "instruction_table.h"
 
 
-/* Check if a line is too long */
-Boolean is_line_too_long(const char *line, int line_number, FILE *input) {
-    
-    if (!line) {
-        return FALSE;
-    }
-    
-    /* Count characters until \n or \0 */
-    if (line[0] != '\0' &&line[strlen(line) - 1] != '\n' && !feof(input))
+/* Check if a line is too long - it and its newline would not fit the line
+   buffer (MAX_LINE_LENGTH - 2 characters at most) */
+Boolean is_line_too_long(const LineSpan *line, int line_number) {
+    if (line->length > MAX_LINE_LENGTH - 2)
     {
         print_error(LINE_TOO_LONG, line_number, NULL);
         return TRUE;
     }
     return FALSE;
-    
-    
+}
+
+
+/* initial number of statements allocated for a program */
+#define PARSED_PROGRAM_INITIAL_CAPACITY 64
+
+/* Prepare an empty parsed program */
+void init_parsed_program(ParsedProgram *program) {
+    program->lines = NULL;
+    program->count = 0;
+    program->capacity = 0;
+}
+
+/* Append a statement slot to the program; NULL on allocation failure */
+ParsedLine *add_parsed_line(ParsedProgram *program) {
+    if (program->count == program->capacity) {
+        int new_capacity = program->capacity ? program->capacity * 2 : PARSED_PROGRAM_INITIAL_CAPACITY;
+        ParsedLine *new_lines = realloc(program->lines, new_capacity * sizeof(ParsedLine));
+        if (!new_lines) {
+            return NULL;
+        }
+        program->lines = new_lines;
+        program->capacity = new_capacity;
+    }
+    return &program->lines[program->count++];
+}
+
+/* Release the statements of a parsed program */
+void free_parsed_program(ParsedProgram *program) {
+    free(program->lines);
+    init_parsed_program(program);
+}
+
+/* Addressing method of an operand (same rules as is_immediate/is_register/is_matrix) */
+static int classify_operand_kind(const char *operand, int length) {
+    if (length > 0 && operand[0] == '#') {
+        return IMMEDIATE_ADDR;
+    }
+    if (length == 2 && operand[0] == 'r' && operand[1] >= '0' && operand[1] <= '7') {
+        return REGISTER_ADDR;
+    }
+    if (memchr(operand, '[', length) && memchr(operand, ']', length)) {
+        return MATRIX_ADDR;
+    }
+    return DIRECT_ADDR;
+}
+
+/* Record the second whitespace separated word (the .entry/.extern symbol) */
+static void parse_directive_symbol(ParsedLine *parsed) {
+    const char *p = parsed->text;
+    const char *start;
+
+    while (*p && isspace((unsigned char)*p))
+        p++;
+    while (*p && !isspace((unsigned char)*p))
+        p++;
+    while (*p && isspace((unsigned char)*p))
+        p++;
+
+    start = p;
+    while (*p && !isspace((unsigned char)*p))
+        p++;
+
+    if (p > start) {
+        parsed->operands[0].start = start - parsed->text;
+        parsed->operands[0].length = p - start;
+        parsed->operand_count = 1;
+    }
+}
+
+/* Split an instruction into opcode and comma separated operands */
+static void parse_instruction(ParsedLine *parsed) {
+    const char *text = parsed->text;
+    const char *p = skip_label(text);
+    const char *word = p;
+    const Keyword *keyword;
+    int i;
+
+    while (*p && !isspace((unsigned char)*p))
+        p++;
+
+    keyword = find_keyword(word, p - word);
+    parsed->opcode = (keyword && keyword->kind == KEYWORD_INSTRUCTION) ? keyword->value : -1;
+
+    /* operands start after the delimiter that ended the mnemonic */
+    if (*p)
+        p++;
+
+    while (parsed->operand_count < 2) {
+        const char *start, *end;
+        TextSpan *span = &parsed->operands[parsed->operand_count];
+
+        while (*p == ',')
+            p++;
+        if (!*p)
+            break;
+
+        start = p;
+        while (*p && *p != ',')
+            p++;
+        end = p;
+
+        while (start < end && isspace((unsigned char)*start))
+            start++;
+        while (end > start && isspace((unsigned char)end[-1]))
+            end--;
+
+        span->start = start - text;
+        span->length = end - start;
+        parsed->operand_kinds[parsed->operand_count] = classify_operand_kind(start, end - start);
+        parsed->operand_count++;
+    }
+
+    /* first word, plus one word per operand (matrix: two); two registers share one */
+    parsed->word_count = 1;
+    if (parsed->operand_count == 2 &&
+        parsed->operand_kinds[0] == REGISTER_ADDR &&
+        parsed->operand_kinds[1] == REGISTER_ADDR) {
+        parsed->word_count = 2;
+        return;
+    }
+    for (i = 0; i < parsed->operand_count; i++) {
+        parsed->word_count += (parsed->operand_kinds[i] == MATRIX_ADDR) ? 2 : 1;
+    }
+}
+
+/* Parse one source line into a statement record */
+void parse_source_line(const char *line, int line_number, ParsedLine *parsed) {
+    const char *text;
+
+    strncpy(parsed->text, line, MAX_LINE_LENGTH - 1);
+    parsed->text[MAX_LINE_LENGTH - 1] = '\0';
+    parsed->text[strcspn(parsed->text, "\n")] = '\0';
+    text = parsed->text;
+
+    parsed->line_number = line_number;
+    parsed->label[0] = '\0';
+    parsed->has_label = extract_label(text, parsed->label);
+    parsed->opcode = -1;
+    parsed->operand_count = 0;
+    parsed->operand_kinds[0] = parsed->operand_kinds[1] = DIRECT_ADDR;
+    parsed->operands[0].start = parsed->operands[1].start = 0;
+    parsed->operands[0].length = parsed->operands[1].length = 0;
+    parsed->word_count = 0;
+
+    if (strstr(text, ".entry")) {
+        parsed->kind = LINE_ENTRY;
+        parse_directive_symbol(parsed);
+    } else if (strstr(text, ".extern")) {
+        parsed->kind = LINE_EXTERN;
+        parse_directive_symbol(parsed);
+    } else if (strstr(text, ".data")) {
+        parsed->kind = LINE_DATA;
+        parsed->word_count = count_data_items(text);
+    } else if (strstr(text, ".string")) {
+        parsed->kind = LINE_STRING;
+        parsed->word_count = count_string_length(text);
+    } else if (strstr(text, ".mat")) {
+        parsed->kind = LINE_MATRIX;
+        parsed->word_count = count_matrix_items(text);
+    } else if (is_command(text)) {
+        parsed->kind = LINE_INSTRUCTION;
+        parse_instruction(parsed);
+    } else {
+        parsed->kind = LINE_UNKNOWN;
+    }
+}
+
+/* Copy operand number index into buffer (MAX_LINE_LENGTH bytes) */
+void get_operand_text(const ParsedLine *parsed, int index, char *buffer) {
+    const TextSpan *span = &parsed->operands[index];
+    strncpy(buffer, parsed->text + span->start, span->length);
+    buffer[span->length] = '\0';
 }
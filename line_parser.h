@@ -0,0 +1,20 @@
+/* line_parser.h - parsing source lines into ParsedLine records */
+#ifndef LINE_PARSER_H
+#define LINE_PARSER_H
+
+#include "types.h"
+#include "text_buffer.h"
+
+/* parsed program storage */
+void init_parsed_program(ParsedProgram *program);
+ParsedLine *add_parsed_line(ParsedProgram *program);
+void free_parsed_program(ParsedProgram *program);
+
+/* checks on a source line before it is copied for parsing */
+Boolean is_line_too_long(const LineSpan *line, int line_number);
+
+/* parsing */
+void parse_source_line(const char *line, int line_number, ParsedLine *parsed);
+void get_operand_text(const ParsedLine *parsed, int index, char *buffer);
+
+#endif /* LINE_PARSER_H */
@@ -1,4 +1,11 @@
 #include "preassembler.h"
+#include "instruction_table.h"
+#include "hash_utils.h"
+#include "text_buffer.h"
+#include "macro_library.h"
+
+/* smallest index size; always a power of two */
+#define GENERIC_INDEX_MIN_CAPACITY 16
 
 /* Check if a name is a macro name */
 Boolean is_macro_name(GenericTable *table, const char *name)
@@ -9,70 +16,61 @@ Boolean is_macro_name(GenericTable *table, const char *name)
 /* Check if a word is a reserved word */
 Boolean is_reserved_word(const char *word)
 {
-    /* Assembly instructions */
-    const char *instructions[] = {
-        "mov", "cmp", "add", "sub", "lea", "clr", "not", "inc",
-        "dec", "jmp", "bne", "jsr", "red", "prn", "rts", "stop"};
-
-    /* Directives */
-    const char *directives[] = {
-        ".data", ".string", ".mat", ".entry", ".extern"};
-
-    /* Registers */
-    const char *registers[] = {
-        "r0", "r1", "r2", "r3", "r4", "r5", "r6", "r7"};
-
-    /* Reserved words */
-    const char *reserved[] = {
-        MACRO_START, MACRO_END};
-
-    int i;
-
     if (!word)
     {
         return FALSE;
     }
 
-    /* Check instructions */
-    for (i = 0; i < sizeof(instructions) / sizeof(instructions[0]); i++)
-    {
-        if (strcmp(word, instructions[i]) == 0)
-        {
-            return TRUE;
-        }
-    }
+    /* instructions, directives, registers, mcro and mcroend */
+    return find_keyword(word, strlen(word)) != NULL;
+}
 
-    /* Check directives */
-    for (i = 0; i < sizeof(directives) / sizeof(directives[0]); i++)
+/* Find the index slot holding name, or the empty slot where it belongs */
+static int find_generic_slot(const GenericTable *table, const char *name)
+{
+    unsigned long mask = (unsigned long)table->index_capacity - 1;
+    unsigned long slot = hash_string(name, (int)strlen(name)) & mask;
+
+    while (table->index[slot] && strcmp(table->index[slot]->name, name) != 0)
     {
-        if (strcmp(word, directives[i]) == 0)
-        {
-            return TRUE;
-        }
+        slot = (slot + 1) & mask;
     }
 
-    /* Check registers */
-    for (i = 0; i < sizeof(registers) / sizeof(registers[0]); i++)
+    return (int)slot;
+}
+
+/* Double the index and re-insert every node; FALSE if out of memory */
+static Boolean grow_generic_index(GenericTable *table)
+{
+    int new_capacity = table->index_capacity * 2;
+    GenericNode **new_index = calloc(new_capacity, sizeof(GenericNode *));
+    GenericNode *current;
+
+    if (!new_index)
     {
-        if (strcmp(word, registers[i]) == 0)
-        {
-            return TRUE;
-        }
+        return FALSE;
     }
 
-    /* Check reserved words */
-    for (i = 0; i < sizeof(reserved) / sizeof(reserved[0]); i++)
+    free(table->index);
+    table->index = new_index;
+    table->index_capacity = new_capacity;
+
+    /* names are unique, so only an empty slot has to be found */
+    for (current = table->head; current; current = current->next)
     {
-        if (strcmp(word, reserved[i]) == 0)
+        unsigned long mask = (unsigned long)new_capacity - 1;
+        unsigned long slot = hash_string(current->name, (int)strlen(current->name)) & mask;
+        while (new_index[slot])
         {
-            return TRUE;
+            slot = (slot + 1) & mask;
         }
+        new_index[slot] = current;
     }
 
-    return FALSE;
+    return TRUE;
 }
 
-GenericTable *create_generic_table(void)
+GenericTable *create_generic_table(Arena *arena)
 {
     GenericTable *table = malloc(sizeof(GenericTable));
     if (!table)
@@ -80,42 +78,44 @@ GenericTable *create_generic_table(void)
         return NULL;
     }
 
+    table->index = calloc(GENERIC_INDEX_MIN_CAPACITY, sizeof(GenericNode *));
+    if (!table->index)
+    {
+        free(table);
+        return NULL;
+    }
+
+    table->arena = arena;
     table->head = NULL;
     table->count = 0;
+    table->index_capacity = GENERIC_INDEX_MIN_CAPACITY;
+    init_text_buffer(&table->text);
+    table->library = NULL;
 
     return table;
 }
 
-/* Free generic table with custom data cleanup function */
+/* Free generic table with custom data cleanup function
+   (nodes and names belong to the table's arena) */
 void free_generic_table(GenericTable *table, void (*cleanup_data)(void *))
 {
     GenericNode *current;
-    GenericNode *next;
 
     if (!table)
     {
         return;
     }
 
-    current = table->head;
-    while (current)
+    for (current = table->head; current && cleanup_data; current = current->next)
     {
-        next = current->next;
-
-        if (current->name)
-        {
-            free(current->name);
-        }
-
-        if (current->data && cleanup_data)
+        if (current->data)
         {
             cleanup_data(current->data);
         }
-
-        free(current);
-        current = next;
     }
 
+    free_text_buffer(&table->text);
+    free(table->index);
     free(table);
 }
 
@@ -123,33 +123,32 @@ void free_generic_table(GenericTable *table, void (*cleanup_data)(void *))
 Boolean add_to_generic_table(GenericTable *table, const char *name, int line_number, void *data)
 {
     GenericNode *new_node;
+    int slot;
 
     if (!table || !name)
     {
         return FALSE;
     }
 
-    /* Check for duplicates */
-    if (find_in_generic_table(table, name))
+    /* Check for duplicates - the slot is where the new node goes */
+    slot = find_generic_slot(table, name);
+    if (table->index[slot])
     {
         return FALSE;
     }
 
-    /* Create new node */
-    new_node = malloc(sizeof(GenericNode));
+    /* Create new node and copy the name */
+    new_node = arena_alloc(table->arena, sizeof(GenericNode));
     if (!new_node)
     {
         return FALSE;
     }
 
-    /* Copy name */
-    new_node->name = malloc(strlen(name) + 1);
+    new_node->name = arena_strdup(table->arena, name);
     if (!new_node->name)
     {
-        free(new_node);
         return FALSE;
     }
-    strcpy(new_node->name, name);
 
     new_node->line_number = line_number;
     new_node->data = data;
@@ -157,124 +156,113 @@ Boolean add_to_generic_table(GenericTable *table, const char *name, int line_num
     table->head = new_node;
     table->count++;
 
+    /* keep the load below 50%; growing re-inserts the new node as well */
+    if (table->count * 2 > table->index_capacity)
+    {
+        if (!grow_generic_index(table))
+        {
+            table->head = new_node->next;
+            table->count--;
+            return FALSE;
+        }
+    }
+    else
+    {
+        table->index[slot] = new_node;
+    }
+
     return TRUE;
 }
 
 /* Find item in generic table */
 GenericNode *find_in_generic_table(GenericTable *table, const char *name)
 {
-    GenericNode *current;
-
     if (!table || !name)
     {
         return NULL;
     }
 
-    current = table->head;
-    while (current)
-    {
-        if (strcmp(current->name, name) == 0)
-        {
-            return current;
-        }
-        current = current->next;
-    }
-
-    return NULL;
+    return table->index[find_generic_slot(table, name)];
 }
 
 /* ===== Specific implementations using generic functions ===== */
 
-/* Macro cleanup function */
-void cleanup_macro_data(void *data)
+/* Create macro table using generic table */
+GenericTable *create_macro_table(Arena *arena)
 {
-    MacroData *macro_data = (MacroData *)data;
-    int i;
-
-    if (!macro_data)
-        return;
-
-    if (macro_data->content)
-    {
-        for (i = 0; i < macro_data->line_count; i++)
-        {
-            if (macro_data->content[i])
-            {
-                free(macro_data->content[i]);
-            }
-        }
-        free(macro_data->content);
-    }
-
-    free(macro_data);
+    return create_generic_table(arena);
 }
 
-/* Create macro table using generic table */
-GenericTable *create_macro_table(void)
+/* Free macro table and its body text (macro data belongs to the table's arena) */
+void free_macro_table(GenericTable *table)
 {
-    return create_generic_table();
+    free_generic_table(table, NULL);
 }
 
-/* Free macro table using generic cleanup */
-void free_macro_table(GenericTable *table)
+/* Append one body line, length bytes ending with its newline, to the
+   table's text */
+Boolean add_macro_line(GenericTable *table, const char *line, size_t length)
 {
-    free_generic_table(table, cleanup_macro_data);
+    return append_to_text_buffer(&table->text, line, length);
 }
 
-/* Add macro using generic function */
-Boolean add_macro(GenericTable *table, const char *name, char **content, int line_count)
+/* Create the data of a macro and add it to the table */
+static Boolean add_macro_data(GenericTable *table, const char *name, const char *body,
+                              size_t offset, size_t length)
 {
     MacroData *macro_data;
-    int i;
 
     /* Create macro data */
-    macro_data = malloc(sizeof(MacroData));
+    macro_data = arena_alloc(table->arena, sizeof(MacroData));
     if (!macro_data)
     {
         return FALSE;
     }
 
-    /* Copy content */
-    macro_data->content = malloc(line_count * sizeof(char *));
-    if (!macro_data->content)
-    {
-        free(macro_data);
-        return FALSE;
-    }
-
-    for (i = 0; i < line_count; i++)
-    {
-        macro_data->content[i] = malloc(strlen(content[i]) + 1);
-        if (!macro_data->content[i])
-        {
-            /* Cleanup on failure */
-            int j;
-            for (j = 0; j < i; j++)
-            {
-                free(macro_data->content[j]);
-            }
-            free(macro_data->content);
-            free(macro_data);
-            return FALSE;
-        }
-        strcpy(macro_data->content[i], content[i]);
-    }
-
-    macro_data->line_count = line_count;
+    macro_data->body = body;
+    macro_data->offset = offset;
+    macro_data->length = length;
+    macro_data->statements = NULL;
+    macro_data->statement_count = 0;
+    macro_data->parsed = FALSE;
 
     return add_to_generic_table(table, name, 0, macro_data);
 }
 
-/* Find macro using generic function */
+/* Add macro using generic function; its body is the length bytes at
+   offset in the table's text, stored there with add_macro_line */
+Boolean add_macro(GenericTable *table, const char *name, size_t offset, size_t length)
+{
+    return add_macro_data(table, name, NULL, offset, length);
+}
+
+/* Find macro using generic function, then in the table's library. A
+   library macro gets a node of its own at its first use in the file,
+   which keeps the statements parsed for its calls; the body stays in
+   the mapped library. */
 GenericNode *find_macro(GenericTable *table, const char *name)
 {
+    GenericNode *node = find_in_generic_table(table, name);
+    const char *body;
+    size_t length;
+
+    if (node || !table || !table->library || !name ||
+        !find_library_macro(table->library, name, &body, &length))
+    {
+        return node;
+    }
+
+    if (!add_macro_data(table, name, body, 0, length))
+    {
+        return NULL;
+    }
     return find_in_generic_table(table, name);
 }
 
 /* Create label table using generic table */
-GenericTable *create_label_table(void)
+GenericTable *create_label_table(Arena *arena)
 {
-    return create_generic_table();
+    return create_generic_table(arena);
 }
 
 /* Free label table (no special cleanup needed) */
@@ -297,87 +285,6 @@ Boolean is_label_already_defined(GenericTable *table, const char *name)
 
 /* ===== Smart label processing functions ===== */
 
-/* Enhanced string utilities using existing functions */
-char *extract_until_char(const char *line, char delimiter)
-{
-    char *pos = strchr(line, delimiter);
-    char *result;
-    int len;
-
-    if (!pos)
-        return NULL;
-
-    len = pos - line;
-    result = malloc(len + 1);
-    if (!result)
-        return NULL;
-
-    strncpy(result, line, len);
-    result[len] = '\0';
-
-    /* Trim whitespace using existing function */
-    return trim_whitespace(result);
-}
-
-/* Extract label name (reusing existing string functions) */
-char *extract_label_name(const char *line)
-{
-    return extract_until_char(line, ':');
-}
-
-/* Get content after character */
-/* Get content after character */
-char *get_content_after_char(const char *line, char delimiter)
-{
-    char *pos = strchr(line, delimiter);
-    char *result;
-    char *trimmed_result;
-
-    if (!pos)
-        return NULL;
-
-    pos++; /* Skip the delimiter */
-
-    /* Allocate new string for the result */
-    result = malloc(strlen(pos) + 1);
-    if (!result)
-        return NULL;
-
-    strcpy(result, pos);
-
-    /* Now trim in place - this is safe because we own the memory */
-    trimmed_result = trim_whitespace(result);
-
-    /* If trimming moved the pointer, we need to move the content */
-    if (trimmed_result != result)
-    {
-        memmove(result, trimmed_result, strlen(trimmed_result) + 1);
-    }
-
-    return result;
-}
-
-/* Get content after label */
-char *get_content_after_label(const char *line)
-{
-    return get_content_after_char(line, ':');
-}
-
-/* Simple label detection */
-Boolean has_label(const char *line)
-{
-    char *colon_pos = strchr(line, ':');
-    char *trimmed;
-
-    if (!colon_pos) return FALSE;
-
-    trimmed = trim_whitespace((char *)line);
-    if (trimmed == colon_pos)
-        return FALSE;
-
-    return TRUE;
-}
-
 /* Validate name (unified for both labels and macros) */
 Boolean is_valid_name(const char *name, Boolean allow_underscore)
 {
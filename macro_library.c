@@ -0,0 +1,305 @@
+/**
+ * @file macro_library.c
+ * @brief Precompiled macro libraries (--macro-lib, --build-macro-lib)
+ *
+ * A library holds the macros of a .as file made only of mcro blocks,
+ * already checked by the pre-assembler, with a hashed index over their
+ * names. It is mapped once and shared by every file: the pre-assembler
+ * looks a name up in it when the source does not define the name
+ * itself, and copies the body straight out of the mapping.
+ *
+ * Layout; numbers are 32 bit, most significant byte first:
+ *
+ *   "ASMMLIB1"                      magic, 8 bytes
+ *   macro count, index capacity, text length
+ *   records   one per macro: name offset, name length,
+ *             body offset, body length (offsets into the text)
+ *   index     index capacity slots: record number + 1, 0 = empty;
+ *             hash_string of the name, linear probing
+ *   text      names (NUL terminated) and bodies (whole lines)
+ *
+ * The index capacity is a power of two above twice the macro count, as
+ * in the macro table. A file is checked completely when it is opened,
+ * so lookups can trust it.
+ */
+
+#include "macro_library.h"
+#include "preassembler.h"
+#include "text_buffer.h"
+#include "hash_utils.h"
+#include "console.h"
+
+#define LIBRARY_MAGIC "ASMMLIB1"
+#define LIBRARY_MAGIC_SIZE 8
+#define LIBRARY_HEADER_SIZE (LIBRARY_MAGIC_SIZE + 3 * 4)
+#define LIBRARY_RECORD_SIZE 16
+#define LIBRARY_SLOT_SIZE 4
+#define LIBRARY_MIN_CAPACITY 16
+
+static unsigned long get_u32(const unsigned char *bytes)
+{
+    return ((unsigned long)bytes[0] << 24) | ((unsigned long)bytes[1] << 16) |
+           ((unsigned long)bytes[2] << 8) | (unsigned long)bytes[3];
+}
+
+static Boolean put_u32(TextBuffer *buffer, unsigned long value)
+{
+    char bytes[4];
+
+    bytes[0] = (char)((value >> 24) & 0xff);
+    bytes[1] = (char)((value >> 16) & 0xff);
+    bytes[2] = (char)((value >> 8) & 0xff);
+    bytes[3] = (char)(value & 0xff);
+    return append_to_text_buffer(buffer, bytes, 4);
+}
+
+/* ===== Reading ===== */
+
+/* Check every record and index slot against the sizes in the header */
+static Boolean check_library(const AsmMacroLibrary *library, unsigned long text_length)
+{
+    unsigned long i, used = 0;
+
+    for (i = 0; i < library->macro_count; i++)
+    {
+        const unsigned char *record = library->records + i * LIBRARY_RECORD_SIZE;
+        unsigned long name_offset = get_u32(record), name_length = get_u32(record + 4);
+        unsigned long body_offset = get_u32(record + 8), body_length = get_u32(record + 12);
+
+        if (name_length == 0 || name_offset >= text_length || name_length >= text_length - name_offset ||
+            library->text[name_offset + name_length] != '\0' ||
+            strlen(library->text + name_offset) != name_length)
+            return FALSE;
+        if (body_offset > text_length || body_length > text_length - body_offset ||
+            (body_length > 0 && library->text[body_offset + body_length - 1] != '\n'))
+            return FALSE;
+    }
+
+    for (i = 0; i < library->index_capacity; i++)
+    {
+        unsigned long slot = get_u32(library->index + i * LIBRARY_SLOT_SIZE);
+
+        if (slot > library->macro_count)
+            return FALSE;
+        if (slot)
+            used++;
+    }
+
+    /* one slot per macro, so a probe always reaches an empty slot */
+    return used == library->macro_count ? TRUE : FALSE;
+}
+
+/* Map a library; NULL, with a message, if it cannot be read or is not one */
+AsmMacroLibrary *asm_macro_library_open(const char *path)
+{
+    AsmMacroLibrary *library = malloc(sizeof(AsmMacroLibrary));
+    const unsigned char *data;
+    unsigned long text_length, size, rest;
+    Boolean valid;
+
+    if (!library)
+    {
+        print_error(MEMORY_ALLOCATION_ERROR, 0, "allocating the macro library");
+        return NULL;
+    }
+
+    init_text_buffer(&library->file);
+    if (!map_file_into_text_buffer(path, &library->file))
+    {
+        console_out("Error: Cannot read macro library %s\n", path);
+        asm_macro_library_close(library);
+        return NULL;
+    }
+
+    data = (const unsigned char *)library->file.data;
+    size = (unsigned long)library->file.length;
+    if (size < LIBRARY_HEADER_SIZE || memcmp(data, LIBRARY_MAGIC, LIBRARY_MAGIC_SIZE) != 0)
+    {
+        console_out("Error: %s is not a macro library\n", path);
+        asm_macro_library_close(library);
+        return NULL;
+    }
+
+    library->macro_count = get_u32(data + LIBRARY_MAGIC_SIZE);
+    library->index_capacity = get_u32(data + LIBRARY_MAGIC_SIZE + 4);
+    text_length = get_u32(data + LIBRARY_MAGIC_SIZE + 8);
+
+    /* The counts come from the file: check that the records, the index
+       and the text fit the mapping before pointing into it. Dividing the
+       room left keeps the arithmetic from wrapping. */
+    rest = size - LIBRARY_HEADER_SIZE;
+    valid = library->index_capacity >= LIBRARY_MIN_CAPACITY &&
+            (library->index_capacity & (library->index_capacity - 1)) == 0 &&
+            library->macro_count <= library->index_capacity / 2 &&
+            rest / LIBRARY_RECORD_SIZE >= library->macro_count;
+    if (valid)
+    {
+        rest -= library->macro_count * LIBRARY_RECORD_SIZE;
+        valid = rest / LIBRARY_SLOT_SIZE >= library->index_capacity &&
+                rest - library->index_capacity * LIBRARY_SLOT_SIZE == text_length;
+    }
+    if (valid)
+    {
+        library->records = data + LIBRARY_HEADER_SIZE;
+        library->index = library->records + library->macro_count * LIBRARY_RECORD_SIZE;
+        library->text = (const char *)(library->index + library->index_capacity * LIBRARY_SLOT_SIZE);
+        valid = check_library(library, text_length);
+    }
+
+    if (!valid)
+    {
+        console_out("Error: Macro library %s is damaged\n", path);
+        asm_macro_library_close(library);
+        return NULL;
+    }
+
+    return library;
+}
+
+void asm_macro_library_close(AsmMacroLibrary *library)
+{
+    if (!library)
+        return;
+    release_mapped_text_buffer(&library->file);
+    free(library);
+}
+
+/* Look a macro up; body receives its lines, newlines included */
+Boolean find_library_macro(const AsmMacroLibrary *library, const char *name,
+                           const char **body, size_t *length)
+{
+    unsigned long mask = library->index_capacity - 1;
+    unsigned long slot = hash_string(name, (int)strlen(name)) & mask;
+    unsigned long entry;
+
+    while ((entry = get_u32(library->index + slot * LIBRARY_SLOT_SIZE)) != 0)
+    {
+        const unsigned char *record = library->records + (entry - 1) * LIBRARY_RECORD_SIZE;
+
+        if (strcmp(library->text + get_u32(record), name) == 0)
+        {
+            *body = library->text + get_u32(record + 8);
+            *length = (size_t)get_u32(record + 12);
+            return TRUE;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    return FALSE;
+}
+
+/* ===== Building ===== */
+
+/* Write the macros defined in table (not those of its own library) */
+static Boolean write_library(const GenericTable *table, const char *path)
+{
+    TextBuffer file, text;
+    const GenericNode *node;
+    unsigned long count = 0, capacity = LIBRARY_MIN_CAPACITY, record;
+    unsigned long *slots;
+    Boolean success;
+
+    for (node = table->head; node; node = node->next)
+    {
+        if (!((const MacroData *)node->data)->body)
+            count++;
+    }
+    while (count * 2 > capacity)
+        capacity *= 2;
+
+    slots = calloc(capacity, sizeof(unsigned long));
+    init_text_buffer(&file);
+    init_text_buffer(&text);
+    success = slots && append_to_text_buffer(&file, LIBRARY_MAGIC, LIBRARY_MAGIC_SIZE) &&
+              put_u32(&file, count) && put_u32(&file, capacity) && put_u32(&file, 0);
+
+    /* records, with the text they point to collected on the side */
+    record = 0;
+    for (node = table->head; success && node; node = node->next)
+    {
+        const MacroData *macro = (const MacroData *)node->data;
+        size_t name_length = strlen(node->name);
+        unsigned long slot = hash_string(node->name, (int)name_length) & (capacity - 1);
+
+        if (macro->body)
+            continue;
+
+        while (slots[slot])
+            slot = (slot + 1) & (capacity - 1);
+        slots[slot] = ++record;
+
+        success = put_u32(&file, (unsigned long)text.length) && put_u32(&file, (unsigned long)name_length) &&
+                  append_to_text_buffer(&text, node->name, name_length + 1) &&
+                  put_u32(&file, (unsigned long)text.length) && put_u32(&file, (unsigned long)macro->length) &&
+                  append_to_text_buffer(&text, table->text.data + macro->offset, macro->length);
+    }
+
+    /* the text length goes in the header, ahead of the records */
+    if (success)
+    {
+        unsigned long i;
+
+        file.data[LIBRARY_MAGIC_SIZE + 8] = (char)((text.length >> 24) & 0xff);
+        file.data[LIBRARY_MAGIC_SIZE + 9] = (char)((text.length >> 16) & 0xff);
+        file.data[LIBRARY_MAGIC_SIZE + 10] = (char)((text.length >> 8) & 0xff);
+        file.data[LIBRARY_MAGIC_SIZE + 11] = (char)(text.length & 0xff);
+        for (i = 0; success && i < capacity; i++)
+            success = put_u32(&file, slots[i]);
+        success = success && append_to_text_buffer(&file, text.data ? text.data : "", text.length) &&
+                  write_text_buffer_to_file(&file, path);
+    }
+
+    free(slots);
+    free_text_buffer(&file);
+    free_text_buffer(&text);
+    return success;
+}
+
+/* Build a library at path from a source holding only mcro blocks */
+int asm_macro_library_build(const char *name, const char *src, size_t len, const char *path)
+{
+    AssemblerContext context;
+    GenericTable *table;
+    TextBuffer source; /* read-only view of src, never freed */
+    TextBuffer expanded;
+    Boolean success;
+
+    source.data = (char *)src;
+    source.length = len;
+    source.capacity = 0;
+
+    init_assembler_context(&context);
+    init_text_buffer(&expanded);
+    table = create_macro_table(&context.arena);
+    if (!table)
+    {
+        print_error(MEMORY_ALLOCATION_ERROR, 0, "Failed to create macro or label table");
+        free_assembler_context(&context);
+        return 0;
+    }
+
+    success = expand_macros(&context, &source, &expanded, table);
+    if (!success)
+    {
+        console_out("Pre-assembler phase failed for file: %s\n", name);
+    }
+    else if (expanded.length > 0)
+    {
+        console_out("Error: %s: a macro library source may only hold mcro blocks\n", name);
+        success = FALSE;
+    }
+    else if (!write_library(table, path))
+    {
+        console_out("Error: Cannot write macro library %s\n", path);
+        success = FALSE;
+    }
+    else
+    {
+        log_info(("Built macro library %s: %d macros\n", path, table->count));
+    }
+
+    free_text_buffer(&expanded);
+    free_macro_table(table);
+    free_assembler_context(&context);
+    return success ? 1 : 0;
+}
@@ -0,0 +1,23 @@
+/* macro_library.h - precompiled macro libraries (--macro-lib, --build-macro-lib) */
+#ifndef MACRO_LIBRARY_H
+#define MACRO_LIBRARY_H
+
+#include "asm.h"
+#include "assembler.h"
+
+/* A mapped .mlib file; the layout is described in macro_library.c */
+struct AsmMacroLibrary
+{
+    TextBuffer file;                 /* the whole file, mapped or read */
+    unsigned long macro_count;
+    unsigned long index_capacity;    /* power of two, above the macro count */
+    const unsigned char *records;    /* macro_count records */
+    const unsigned char *index;      /* index_capacity slots */
+    const char *text;                /* names and bodies */
+};
+
+/* Look a macro up; body receives its lines, newlines included */
+Boolean find_library_macro(const AsmMacroLibrary *library, const char *name,
+                           const char **body, size_t *length);
+
+#endif /* MACRO_LIBRARY_H */
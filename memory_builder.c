@@ -7,10 +7,15 @@
  * add instructions and data, and manage the memory layout.
  */
 
+/* for strtok_r under -ansi */
+#define _POSIX_C_SOURCE 200112L
+
 #include "memory_builder.h"
 #include "line_analysis.h"
 #include "instruction_table.h"
 #include "symbol_table.h"
+#include "line_parser.h"
+#include "console.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -41,6 +46,7 @@ void init_memory_image(MemoryImage *memory)
     memory->data_count = 0;
     memory->ICF = 0;
     memory->DCF = 0;
+    memory->fixup_count = 0;
 }
 
 /**
@@ -57,7 +63,7 @@ Boolean add_data_word(MemoryImage *memory, int address, MachineWord word)
         return FALSE;
     if (memory->data_count >= MEMORY_SIZE)
     {
-        printf("Error: data image overflow at address %d\n", address);
+        console_out("Error: data image overflow at address %d\n", address);
         return FALSE;
     }
     idx = memory->data_count++;
@@ -79,7 +85,7 @@ Boolean add_instruction_word(MemoryImage *memory, int address, MachineWord word)
         return FALSE;
     if (memory->instruction_count >= MEMORY_SIZE)
     {
-        printf("Error: instruction image overflow at address %d\n", address);
+        console_out("Error: instruction image overflow at address %d\n", address);
         return FALSE;
     }
     idx = memory->instruction_count++;
@@ -95,7 +101,7 @@ Boolean update_instruction_word(MemoryImage *memory, int address, MachineWord wo
     idx = address - BASE_ADDRESS;
     if (idx < 0 || idx >= memory->instruction_count)
     {
-        printf("Error: update address %d out of range (valid: %d..%d)\n",
+        console_out("Error: update address %d out of range (valid: %d..%d)\n",
                address,
                BASE_ADDRESS,
                BASE_ADDRESS + memory->instruction_count - 1);
@@ -106,83 +112,91 @@ Boolean update_instruction_word(MemoryImage *memory, int address, MachineWord wo
     return TRUE;
 }
 
-/* build memory image from .am file */
-Boolean build_memory_image(const char *am_filename, MemoryImage *memory)
+/**
+ * @brief Record that the next instruction word is a symbol placeholder
+ * @param memory Pointer to memory image
+ * @param operand Direct or matrix operand ("LABEL" or "LABEL[rX][rY]")
+ * @param line_number Source line, for error messages in the second pass
+ * @return TRUE on success, FALSE on overflow
+ *
+ * Must be called right before the placeholder word is added; the second
+ * pass patches the recorded words without looking at the source again.
+ */
+Boolean add_fixup(MemoryImage *memory, const char *operand, int line_number)
 {
-    FILE *file;
-    char line[MAX_LINE_LENGTH];
-    int line_number = 0;
-    int current_ic = BASE_ADDRESS;
-    int current_dc = 0;
-    Boolean has_errors = FALSE;
+    Fixup *fixup;
+    int length = 0;
 
-    /* initialize memory image */
-    init_memory_image(memory);
-
-    file = fopen(am_filename, "r");
-    if (!file)
+    if (!memory)
+        return FALSE;
+    if (memory->fixup_count >= MEMORY_SIZE)
     {
-        printf("Error: Cannot open file %s for memory building\n", am_filename);
+        console_out("Error: too many symbol references at line %d\n", line_number);
         return FALSE;
     }
 
-    printf("Building memory image from: %s\n", am_filename);
+    fixup = &memory->fixups[memory->fixup_count++];
+    fixup->word_index = memory->instruction_count;
+    fixup->line_number = line_number;
 
-    /* iterate over the file */
-    while (fgets(line, sizeof(line), file))
+    /* symbol name - for matrix addressing the base name before '[' */
+    while (operand[length] && operand[length] != '[' && length < MAX_LABEL_LENGTH - 1)
     {
-        line_number++;
-        line[strcspn(line, "\n")] = '\0';
-
-        if (is_comment_or_empty(line))
-        {
-            continue;
-        }
+        fixup->symbol_name[length] = operand[length];
+        length++;
+    }
+    fixup->symbol_name[length] = '\0';
+    return TRUE;
+}
 
-        /* skip .entry and .extern */
-        if (strstr(line, ".entry") || strstr(line, ".extern"))
-        {
-            continue;
-        }
+/* build the context's memory image from the statements parsed by the first pass */
+Boolean build_memory_image(AssemblerContext *ctx, const ParsedProgram *program)
+{
+    MemoryImage *memory = &ctx->memory;
+    int i;
+    int current_ic = BASE_ADDRESS;
+    int current_dc = 0;
+    Boolean has_errors = FALSE;
 
-        /* process data directives */
-        if (strstr(line, ".data"))
-        {
-            encode_data_directive(line, memory, &current_dc, line_number);
-            continue;
-        }
+    /* initialize memory image */
+    init_memory_image(memory);
 
-        if (strstr(line, ".string"))
-        {
-            encode_string_directive(line, memory, &current_dc, line_number);
-            continue;
-        }
+    log_verbose(("Building memory image from %d statements\n", program->count));
 
-        if (strstr(line, ".mat"))
-        {
-            encode_matrix_directive(line, memory, &current_dc, line_number);
-            continue;
-        }
+    /* iterate over the parsed statements; .entry and .extern take no memory */
+    for (i = 0; i < program->count; i++)
+    {
+        const ParsedLine *line = &program->lines[i];
 
-        /* process instruction lines */
-        if (is_command(line))
+        switch (line->kind)
         {
-            encode_instruction_first_pass(line, memory, &current_ic, line_number);
+        case LINE_DATA:
+            encode_data_directive(line->text, memory, &current_dc, line->line_number);
+            break;
+        case LINE_STRING:
+            encode_string_directive(line->text, memory, &current_dc, line->line_number);
+            break;
+        case LINE_MATRIX:
+            encode_matrix_directive(line->text, memory, &current_dc, line->line_number);
+            break;
+        case LINE_INSTRUCTION:
+            encode_instruction_first_pass(line, memory, &current_ic);
+            break;
+        default:
+            break;
         }
     }
 
     memory->ICF = current_ic;
     memory->DCF = current_dc;
 
-    fclose(file);
-
     if (has_errors)
     {
-        printf("Errors occurred while building memory image\n");
+        console_out("Errors occurred while building memory image\n");
         return FALSE;
     }
 
-    printf("Memory image built successfully. IC=%d, DC=%d\n", memory->ICF, memory->DCF);
+    log_verbose(("Memory image built successfully. IC=%d, DC=%d\n", memory->ICF, memory->DCF));
     return TRUE;
 }
 
@@ -191,28 +205,29 @@ void encode_data_directive(const char *line, MemoryImage *memory, int *current_d
 {
     char line_copy[MAX_LINE_LENGTH];
     char *token;
+    char *save;
     int value;
     MachineWord data_word;
 
     strcpy(line_copy, line);
 
     /* skip label if present */
-    token = strtok(line_copy, " \t");
+    token = strtok_r(line_copy, " \t", &save);
     if (token && strchr(token, ':'))
     {
-        token = strtok(NULL, " \t");
+        token = strtok_r(NULL, " \t", &save);
     }
 
     /* skip the ".data" token */
     if (token && strcmp(token, ".data") == 0)
     {
-        token = strtok(NULL, " \t");
+        token = strtok_r(NULL, " \t", &save);
     }
 
     /* process comma-separated values */
     if (token)
     {
-        token = strtok(token, ",");
+        token = strtok_r(token, ",", &save);
         while (token && memory->data_count < MEMORY_SIZE)
         {
             while (isspace(*token))
@@ -229,7 +244,7 @@ void encode_data_directive(const char *line, MemoryImage *memory, int *current_d
             add_data_word(memory, BASE_ADDRESS + memory->instruction_count + *current_dc, data_word);
             (*current_dc)++;
 
-            token = strtok(NULL, ",");
+            token = strtok_r(NULL, ",", &save);
         }
     }
 }
@@ -286,6 +301,7 @@ void encode_matrix_directive(const char *line, MemoryImage *memory, int *current
     char line_copy[MAX_LINE_LENGTH];
     char *values_start;
     char *token;
+    char *save;
     int value;
     MachineWord data_word;
     int count = 0; /* Debug counter */
@@ -312,7 +328,7 @@ void encode_matrix_directive(const char *line, MemoryImage *memory, int *current
     }
 
 
-    token = strtok(values_start, ",");
+    token = strtok_r(values_start, ",", &save);
     while (token && memory->data_count < MEMORY_SIZE)
     {
         while (isspace(*token))
@@ -330,100 +346,48 @@ void encode_matrix_directive(const char *line, MemoryImage *memory, int *current
         (*current_dc)++;
         count++;
 
-        token = strtok(NULL, ",");
+        token = strtok_r(NULL, ",", &save);
     }
     
 }
 
 /* encode instruction for the first pass */
-/* encode instruction for the first pass */
-void encode_instruction_first_pass(const char *line, MemoryImage *memory, int *current_ic, int line_number)
+void encode_instruction_first_pass(const ParsedLine *line, MemoryImage *memory, int *current_ic)
 {
-    char line_copy[MAX_LINE_LENGTH];
-    char *token,*end;
-    char *instruction_name;
     char operand1[MAX_LINE_LENGTH] = "";
     char operand2[MAX_LINE_LENGTH] = "";
-    
-    int operand_count = 0;
-    InstructionDef *instr;
-    int opcode;
+    int operand_count = line->operand_count;
     int src_method = 0, dest_method = 0;
     MachineWord first_word, w;
-    int src_reg, dest_reg,reg;
+    int src_reg, dest_reg, reg;
     int row_reg, col_reg;
-        (void) line_number; /* unused here; keep for interface compatibility */
 
-    strcpy(line_copy, line);
-
-    /* skip label if present */
-    token = strtok(line_copy, " \t");
-    if (token && strchr(token, ':'))
-    {
-        token = strtok(NULL, " \t");
-    }
-
-    instruction_name = token;
-    if (!instruction_name)
+    if (line->opcode < 0)
         return;
-    /* locate instruction */
-    instr = find_instruction(instruction_name);
-    if (!instr)
-        return;
-
-    opcode = get_opcode_value(instruction_name);
-
-    /* parse operands (trim leading and trailing whitespace) */
-    token = strtok(NULL, ",");
-    if (token)
-    {
-        while (isspace((unsigned char)*token))
-            token++;
-        strcpy(operand1, token);
-        end = operand1 + strlen(operand1) - 1;
-        while (end >= operand1 && isspace((unsigned char)*end))
-        {
-            *end-- = '\0';
-        }
-        operand_count++;
-
-        token = strtok(NULL, ",");
-        if (token)
-        {
-            while (isspace((unsigned char)*token))
-                token++;
-            strcpy(operand2, token);
-            end = operand2 + strlen(operand2) - 1;
-            while (end >= operand2 && isspace((unsigned char)*end))
-            {
-                *end-- = '\0';
-            }
-            operand_count++;
-        }
-    }
 
-    /* addressing methods for first word */
     if (operand_count >= 1)
     {
-        src_method = get_addressing_method(operand1);
+        get_operand_text(line, 0, operand1);
+        src_method = line->operand_kinds[0];
     }
     if (operand_count >= 2)
     {
-        dest_method = get_addressing_method(operand2);
+        get_operand_text(line, 1, operand2);
+        dest_method = line->operand_kinds[1];
     }
 
     /* emit first (opcode) word */
-    first_word = encode_first_word(opcode, src_method, dest_method);
+    first_word = encode_first_word(line->opcode, src_method, dest_method);
     add_instruction_word(memory, *current_ic, first_word);
     (*current_ic)++;
 
     /* --- emit additional operand words --- */
 
     /* special case: two registers share one word */
-    if (operand_count == 2 && is_register(operand1) && is_register(operand2))
+    if (operand_count == 2 && src_method == REGISTER_ADDR && dest_method == REGISTER_ADDR)
     {
-        src_reg = atoi(operand1 + 1); /* 'rX' -> X */
-        dest_reg = atoi(operand2 + 1);
+        src_reg = operand1[1] - '0'; /* 'rX' -> X */
+        dest_reg = operand2[1] - '0';
         w = encode_register_operand(src_reg, dest_reg);
         add_instruction_word(memory, *current_ic, w);
         (*current_ic)++;
@@ -433,84 +397,75 @@ void encode_instruction_first_pass(const char *line, MemoryImage *memory, int *c
     /* source operand (if exists) */
     if (operand_count >= 1)
     {
-        if (operand1[0] == '#')
+        switch (src_method)
         {
-            /* immediate */
+        case IMMEDIATE_ADDR:
             w = encode_immediate_operand(atoi(operand1 + 1));
             add_instruction_word(memory, *current_ic, w);
             (*current_ic)++;
-        }
-        else if (is_register(operand1))
-        {
+            break;
+        case REGISTER_ADDR:
             /* single register (source-only field) */
-            reg = atoi(operand1 + 1);
+            reg = operand1[1] - '0';
             w = encode_register_operand(reg, 0);
             add_instruction_word(memory, *current_ic, w);
             (*current_ic)++;
+            break;
+        case MATRIX_ADDR:
+            /* matrix operand needs 2 words: base address (patched in the
+               second pass) and the register indices like r2,r7 -> 0010-0111-00 */
+            w.bits = 0;
+            add_fixup(memory, operand1, line->line_number);
+            add_instruction_word(memory, *current_ic, w);
+            (*current_ic)++;
+            extract_matrix_registers(operand1, &row_reg, &col_reg);
+            w.bits = ((row_reg & 0xF) << 6) | ((col_reg & 0xF) << 2);
+            add_instruction_word(memory, *current_ic, w);
+            (*current_ic)++;
+            break;
+        default:
+            /* direct symbol -> placeholder to be patched in second pass */
+            w.bits = 0;
+            add_fixup(memory, operand1, line->line_number);
+            add_instruction_word(memory, *current_ic, w);
+            (*current_ic)++;
+            break;
         }
-       else if (is_matrix(operand1))
-{
-    /* matrix operand needs 2 words */
-    /* First word: base address (placeholder for second pass) */
-    w.bits = 0; 
-    add_instruction_word(memory, *current_ic, w);
-    (*current_ic)++;
-    
-    /* Second word: encode the register indices like r2,r7 -> 0010-0111-00 */
-    /* Second word: encode the register indices */
-{
-    
-    extract_matrix_registers(operand1, &row_reg, &col_reg);
-    w.bits = ((row_reg & 0xF) << 6) | ((col_reg & 0xF) << 2);
-} /* temporary encoding for r2,r7 - should extract from operand1 */
-    add_instruction_word(memory, *current_ic, w);
-    (*current_ic)++;
-}
-else
-{
-    /* direct symbol -> placeholder to be patched in second pass */
-    w.bits = 0;
-    add_instruction_word(memory, *current_ic, w);
-    (*current_ic)++;
-}
     }
 
     /* destination operand (if exists) */
     if (operand_count >= 2)
     {
-        if (operand2[0] == '#')
+        switch (dest_method)
         {
-            /* immediate */
+        case IMMEDIATE_ADDR:
             w = encode_immediate_operand(atoi(operand2 + 1));
             add_instruction_word(memory, *current_ic, w);
             (*current_ic)++;
-        }
-        else if (is_register(operand2))
-    {
-        /* single register (source-only field) */
-        reg = atoi(operand2 + 1);
-        w = encode_register_operand(reg, 0);
-        add_instruction_word(memory, *current_ic, w);
-        (*current_ic)++;
-    }
-    else if (is_matrix(operand2))
-    {
-        /* matrix operand needs 2 words */
-        w.bits = 0; 
-        add_instruction_word(memory, *current_ic, w);
-        (*current_ic)++;
-        /* second word for matrix - placeholder */
-        w.bits = 0;
-        add_instruction_word(memory, *current_ic, w);
-        (*current_ic)++;
-    }
-   
-        else
-        {
-            /* direct/matrix symbol -> placeholder to be patched in second pass */
+            break;
+        case REGISTER_ADDR:
+            /* single register (source-only field) */
+            reg = operand2[1] - '0';
+            w = encode_register_operand(reg, 0);
+            add_instruction_word(memory, *current_ic, w);
+            (*current_ic)++;
+            break;
+        case MATRIX_ADDR:
+            /* matrix operand needs 2 words, both placeholders */
             w.bits = 0;
+            add_fixup(memory, operand2, line->line_number);
+            add_instruction_word(memory, *current_ic, w);
+            (*current_ic)++;
             add_instruction_word(memory, *current_ic, w);
             (*current_ic)++;
+            break;
+        default:
+            /* direct symbol -> placeholder to be patched in second pass */
+            w.bits = 0;
+            add_fixup(memory, operand2, line->line_number);
+            add_instruction_word(memory, *current_ic, w);
+            (*current_ic)++;
+            break;
         }
     }
 }
@@ -518,39 +473,9 @@ else
 /* get opcode value */
 int get_opcode_value(const char *instruction_name)
 {
-    if (strcmp(instruction_name, "mov") == 0)
-        return 0;
-    if (strcmp(instruction_name, "cmp") == 0)
-        return 1;
-    if (strcmp(instruction_name, "add") == 0)
-        return 2;
-    if (strcmp(instruction_name, "sub") == 0)
-        return 3;
-    if (strcmp(instruction_name, "lea") == 0)
-        return 4;
-    if (strcmp(instruction_name, "clr") == 0)
-        return 5;
-    if (strcmp(instruction_name, "not") == 0)
-        return 6;
-    if (strcmp(instruction_name, "inc") == 0)
-        return 7;
-    if (strcmp(instruction_name, "dec") == 0)
-        return 8;
-    if (strcmp(instruction_name, "jmp") == 0)
-        return 9;
-    if (strcmp(instruction_name, "bne") == 0)
-        return 10;
-    if (strcmp(instruction_name, "jsr") == 0)
-        return 11;
-    if (strcmp(instruction_name, "red") == 0)
-        return 12;
-    if (strcmp(instruction_name, "prn") == 0)
-        return 13;
-    if (strcmp(instruction_name, "rts") == 0)
-        return 14;
-    if (strcmp(instruction_name, "stop") == 0)
-        return 15;
-    return -1; /* unknown instruction */
+    InstructionDef *instr = find_instruction(instruction_name);
+
+    return instr ? instr->opcode : -1; /* -1 for unknown instruction */
 }
 
 /* get addressing method */
@@ -576,22 +501,29 @@ int get_addressing_method(const char *operand)
 
     return DIRECT_ADDR; /* 1 - direct */
 }
+/*
+ * First-word templates indexed by [opcode][source mode][destination mode]:
+ * bits 6-9 opcode, bits 4-5 source method, bits 2-3 destination method,
+ * bits 0-1 A,R,E (always 0 in the first word).
+ */
+#define FIRST_WORD(op, src, dst) (((op) << 6) | ((src) << 4) | ((dst) << 2))
+#define FIRST_WORD_DST(op, src) \
+    {FIRST_WORD(op, src, 0), FIRST_WORD(op, src, 1), FIRST_WORD(op, src, 2), FIRST_WORD(op, src, 3)}
+#define FIRST_WORD_OP(op) \
+    {FIRST_WORD_DST(op, 0), FIRST_WORD_DST(op, 1), FIRST_WORD_DST(op, 2), FIRST_WORD_DST(op, 3)}
+
+static const unsigned short first_word_templates[16][4][4] = {
+    FIRST_WORD_OP(0), FIRST_WORD_OP(1), FIRST_WORD_OP(2), FIRST_WORD_OP(3),
+    FIRST_WORD_OP(4), FIRST_WORD_OP(5), FIRST_WORD_OP(6), FIRST_WORD_OP(7),
+    FIRST_WORD_OP(8), FIRST_WORD_OP(9), FIRST_WORD_OP(10), FIRST_WORD_OP(11),
+    FIRST_WORD_OP(12), FIRST_WORD_OP(13), FIRST_WORD_OP(14), FIRST_WORD_OP(15)};
+
 /* encode first word */
 MachineWord encode_first_word(int opcode, int src_method, int dest_method)
 {
     MachineWord word;
-    word.bits = 0;
-     /* bits 6-9: opcode */
-    word.bits |= (opcode & 0xF) << 6;
-
-    /* bits 4-5: source addressing method */
-    word.bits |= (src_method & 0x3) << 4;
-
-    /* bits 2-3: destination addressing method */
-    word.bits |= (dest_method & 0x3) << 2;
-
-    /* bits 0-1: A,R,E - default value 0 */
 
+    word.bits = first_word_templates[opcode & 0xF][src_method & 0x3][dest_method & 0x3];
     return word;
 }
 /* encode immediate operand */
@@ -632,6 +564,7 @@ void free_memory_image(MemoryImage *memory)
     memory->data_count = 0;
     memory->ICF = BASE_ADDRESS;
     memory->DCF = 0;
+    memory->fixup_count = 0;
 }
 void extract_matrix_registers(const char *matrix_operand, int *row_reg, int *col_reg)
 {
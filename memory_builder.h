@@ -3,13 +3,14 @@
 #define MEMORY_BUILDER_H
 
 #include "types.h"
+#include "context.h"
 
 /* main functions */
-Boolean build_memory_image(const char *am_filename, MemoryImage *memory);
+Boolean build_memory_image(AssemblerContext *ctx, const ParsedProgram *program);
 void init_memory_image(MemoryImage *memory);
 
 /* instruction processing */
-void encode_instruction_first_pass(const char *line, MemoryImage *memory, int *current_ic, int line_number);
+void encode_instruction_first_pass(const ParsedLine *line, MemoryImage *memory, int *current_ic);
 
 /* data directives processing */
 void encode_data_directive(const char *line, MemoryImage *memory, int *current_dc, int line_number);
@@ -20,6 +21,7 @@ void encode_matrix_directive(const char *line, MemoryImage *memory, int *current
 Boolean add_data_word(MemoryImage *memory, int address, MachineWord word);
 Boolean add_instruction_word(MemoryImage *memory, int address, MachineWord word);
 Boolean update_instruction_word(MemoryImage *memory, int address, MachineWord word);
+Boolean add_fixup(MemoryImage *memory, const char *operand, int line_number);
 void free_memory_image(MemoryImage *memory);
 
 /* helper functions */
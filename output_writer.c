@@ -2,334 +2,137 @@
 #include "memory_builder.h"
 #include "line_analysis.h"
 #include "instruction_table.h"
-
-/* Generate all output files */
-Boolean generate_output_files(const char *filename, MemoryImage *memory,
-                              ExtRef *ext_list, EntryPoint *entry_list)
+#include "context.h"
+#include "text_buffer.h"
+#include "console.h"
+
+/* unique base-4 ("a".."d") digits of every 10-bit word, most significant
+   first, generated at compile time; not NUL terminated */
+#define WORD_DIGITS 5
+#define DIGIT(v, shift) ('a' + (((v) >> (shift)) & 3))
+#define W1(v) {DIGIT(v, 8), DIGIT(v, 6), DIGIT(v, 4), DIGIT(v, 2), DIGIT(v, 0)}
+#define W4(v) W1(v), W1((v) + 1), W1((v) + 2), W1((v) + 3)
+#define W16(v) W4(v), W4((v) + 4), W4((v) + 8), W4((v) + 12)
+#define W64(v) W16(v), W16((v) + 16), W16((v) + 32), W16((v) + 48)
+#define W256(v) W64(v), W64((v) + 64), W64((v) + 128), W64((v) + 192)
+
+static const char word_digits[1024][WORD_DIGITS] = {
+    W256(0), W256(256), W256(512), W256(768)
+};
+
+/* addresses are written with 4 digits - the low 8 bits of the address */
+#define ADDRESS_DIGITS 4
+#define A1(v) {DIGIT(v, 6), DIGIT(v, 4), DIGIT(v, 2), DIGIT(v, 0)}
+#define A4(v) A1(v), A1((v) + 1), A1((v) + 2), A1((v) + 3)
+#define A16(v) A4(v), A4((v) + 4), A4((v) + 8), A4((v) + 12)
+#define A64(v) A16(v), A16((v) + 16), A16((v) + 32), A16((v) + 48)
+
+static const char address_digits[256][ADDRESS_DIGITS] = {
+    A64(0), A64(64), A64(128), A64(192)
+};
+
+/* "<address> <word>\n" */
+#define OB_LINE_SIZE (ADDRESS_DIGITS + 1 + WORD_DIGITS + 1)
+/* header plus a full instruction image and a full data image */
+#define OB_BUFFER_SIZE (2 * (WORD_DIGITS + 1) + 2 * MEMORY_SIZE * OB_LINE_SIZE)
+
+/* Append one object line; returns the position after it */
+static char *put_object_line(char *out, int address, int word)
 {
-    Boolean success = TRUE;
-
-    /* Always generate .ob file */
-    if (!write_object_file(filename, memory))
-    {
-        printf("Error: Failed to write object file\n");
-        success = FALSE;
-    }
-
-    /* Generate .ent file only if there are entry points */
-    if (count_entries(entry_list) > 0)
-    {
-        if (!write_entries_file(filename, entry_list))
-        {
-            printf("Error: Failed to write entries file\n");
-            success = FALSE;
-        }
-    }
+    memcpy(out, address_digits[address & 0xFF], ADDRESS_DIGITS);
+    out[ADDRESS_DIGITS] = ' ';
+    memcpy(out + ADDRESS_DIGITS + 1, word_digits[word & 0x3FF], WORD_DIGITS);
+    out[OB_LINE_SIZE - 1] = '\n';
+    return out + OB_LINE_SIZE;
+}
 
-    /* Generate .ext file only if there are external references */
-    if (count_externals(ext_list) > 0)
-    {
-        if (!write_externals_file(filename, ext_list))
-        {
-            printf("Error: Failed to write externals file\n");
-            success = FALSE;
-        }
-    }
+/* Append a header count without its leading 'a' digits (at least one digit stays) */
+static char *put_header_count(char *out, int count)
+{
+    const char *digits = word_digits[count & 0x3FF];
+    int skip = 0;
 
-    return success;
+    while (skip < WORD_DIGITS - 1 && digits[skip] == 'a')
+        skip++;
+    memcpy(out, digits + skip, WORD_DIGITS - skip);
+    return out + WORD_DIGITS - skip;
 }
 
-/* Write .ob (object) file */
-Boolean write_object_file(const char *filename, MemoryImage *memory)
+/* Format the .ob file - into one buffer, appended to out in one go */
+Boolean format_object_file(const AssemblerContext *ctx, TextBuffer *out)
 {
-    FILE *file;
-    char *base_name;
-    char *obj_filename;
-    char *ic_base4, *dc_base4, *ic_trimmed, *dc_trimmed;
-    char *address_base4, *word_base4;
+    const MemoryImage *memory = &ctx->memory;
+    char buffer[OB_BUFFER_SIZE];
+    char *end = buffer;
     int i;
     int calculated_address;
-    /* Create output filename */
-    base_name = get_base_filename(filename);
-    if (!base_name)
-        return FALSE;
-
-    obj_filename = malloc(strlen(base_name) + 4 + 1); /* ".ob" + '\0' */
-    if (!obj_filename)
-    {
-        free(base_name);
-        return FALSE;
-    }
-    sprintf(obj_filename, "%s.ob", base_name);
-
-    /* Open file for writing */
-    file = fopen(obj_filename, "w");
-    if (!file)
-    {
-        printf("Error: Cannot create object file %s\n", obj_filename);
-        free(base_name);
-        free(obj_filename);
-        return FALSE;
-    }
 
     /* Header: IC and DC in base-4 (trim leading 'a's) */
+    end = put_header_count(end, memory->instruction_count);
+    *end++ = ' ';
+    end = put_header_count(end, memory->data_count);
+    *end++ = '\n';
 
-    ic_base4 = decimal_to_base4(memory->instruction_count, 5);
-    dc_base4 = decimal_to_base4(memory->data_count, 5);
-
-    
-
-
-    if (!ic_base4 || !dc_base4)
-    {
-        printf("Error: Failed to convert header to base 4\n");
-        fclose(file);
-        free(base_name);
-        free(obj_filename);
-        if (ic_base4)
-            free(ic_base4);
-        if (dc_base4)
-            free(dc_base4);
-        return FALSE;
-    }
-
-    ic_trimmed = ic_base4;
-    dc_trimmed = dc_base4;
-    while (*ic_trimmed == 'a' && strlen(ic_trimmed) > 1)
-        ic_trimmed++;
-    while (*dc_trimmed == 'a' && strlen(dc_trimmed) > 1)
-        dc_trimmed++;
-
-    fprintf(file, "%s %s\n", ic_trimmed, dc_trimmed);
-    /* Write instruction image: addr(4), word(5) */
+    /* Instruction image: addr(4), word(5) */
     for (i = 0; i < memory->instruction_count; i++)
     {
-        printf("Instruction[%d] at addr %d: decimal=%d, binary=", 
-           i, BASE_ADDRESS + i, memory->instruction_image[i].bits);
-        address_base4 = decimal_to_base4(BASE_ADDRESS + i, 4);
-        
-        word_base4 = decimal_to_base4(memory->instruction_image[i].bits & 0x3FF, 5);
-         
-        if (!address_base4 || !word_base4)
-        {
-            printf("Error: Failed to convert instruction to base 4\n");
-            fclose(file);
-            free(base_name);
-            free(obj_filename);
-            free(ic_base4);
-            free(dc_base4);
-            if (address_base4)
-                free(address_base4);
-            if (word_base4)
-                free(word_base4);
-            return FALSE;
-        }
-        fprintf(file, "%s %s\n", address_base4, word_base4);
-        free(address_base4);
-        free(word_base4);
-        }
-    
+        log_debug(("Instruction[%d] at addr %d: decimal=%d\n",
+           i, BASE_ADDRESS + i, memory->instruction_image[i].bits));
+        end = put_object_line(end, BASE_ADDRESS + i, memory->instruction_image[i].bits);
+    }
 
-    
     for (i = 0; i < memory->data_count; i++)
     {
         calculated_address = BASE_ADDRESS + memory->instruction_count + i;
-        printf("Data[%d] at addr %d: decimal=%d\n", i, BASE_ADDRESS + memory->instruction_count + i, memory->data_image[i].bits);
-         
-    
-        address_base4 = decimal_to_base4(calculated_address, 4);
-        word_base4 = decimal_to_base4(memory->data_image[i].bits & 0x3FF, 5);
-        if (!address_base4 || !word_base4)
-        {
-            printf("Error: Failed to convert data to base 4\n");
-            fclose(file);
-            free(base_name);
-            free(obj_filename);
-            free(ic_base4);
-            free(dc_base4);
-            if (address_base4)
-                free(address_base4);
-            if (word_base4)
-                free(word_base4);
-            return FALSE;
-        }
-        fprintf(file, "%s %s\n", address_base4, word_base4);
-        free(address_base4);
-        free(word_base4);
+        log_debug(("Data[%d] at addr %d: decimal=%d\n", i, BASE_ADDRESS + memory->instruction_count + i, memory->data_image[i].bits));
+        end = put_object_line(end, calculated_address, memory->data_image[i].bits);
     }
 
-    fclose(file);
-
-    printf("Generated object file: %s\n", obj_filename);
-
-    free(base_name);
-    free(obj_filename);
-    free(ic_base4);
-    free(dc_base4);
-
-    return TRUE;
+    return append_to_text_buffer(out, buffer, end - buffer);
 }
 
-/* Write .ent (entries) file */
-Boolean write_entries_file(const char *filename, EntryPoint *entry_list)
+/* Append one "<symbol> <address>" line */
+static Boolean put_symbol_line(TextBuffer *out, const char *symbol_name, int address)
 {
-    FILE *file;
-    char *base_name;
-    char *ent_filename;
-    char *address_base4;
-    EntryPoint *current;
-
-    if (!entry_list)
-        return TRUE; /* No entries to write */
-
-    /* Create output filename */
-    base_name = get_base_filename(filename);
-    if (!base_name)
-        return FALSE;
-
-    ent_filename = malloc(strlen(base_name) + 6); /* +5 for ".ent" +1 for null */
-    if (!ent_filename)
-    {
-        free(base_name);
-        return FALSE;
-    }
-    sprintf(ent_filename, "%s.ent", base_name);
-
-    /* Open file for writing */
-    file = fopen(ent_filename, "w");
-    if (!file)
-    {
-        printf("Error: Cannot create entries file %s\n", ent_filename);
-        free(base_name);
-        free(ent_filename);
-        return FALSE;
-    }
-
-    /* Write each entry point */
-    current = entry_list;
-    while (current)
-    {
-        address_base4 = decimal_to_base4(current->address, 4);
-        if (!address_base4)
-        {
-            printf("Error: Failed to convert entry address to base 4\n");
-            fclose(file);
-            free(base_name);
-            free(ent_filename);
-            return FALSE;
-        }
-
-        fprintf(file, "%s %s\n", current->symbol_name, address_base4);
-        free(address_base4);
-        current = current->next;
-    }
-
-    fclose(file);
-    free(base_name);
-    free(ent_filename);
-
-    printf("Generated entries file: %s\n", ent_filename);
-    return TRUE;
+    return append_to_text_buffer(out, symbol_name, strlen(symbol_name)) &&
+           append_to_text_buffer(out, " ", 1) &&
+           append_to_text_buffer(out, address_digits[address & 0xFF], ADDRESS_DIGITS) &&
+           append_to_text_buffer(out, "\n", 1);
 }
 
-/* Write .ext (externals) file */
-Boolean write_externals_file(const char *filename, ExtRef *ext_list)
+/* Format the .ent file (empty when there are no entry points) */
+Boolean format_entries_file(const AssemblerContext *ctx, TextBuffer *out)
 {
-    FILE *file;
-    char *base_name;
-    char *ext_filename;
-    char *address_base4;
-    ExtRef *current;
-
-    if (!ext_list)
-        return TRUE; /* No externals to write */
-
-    /* Create output filename */
-    base_name = get_base_filename(filename);
-    if (!base_name)
-        return FALSE;
+    const EntryPoint *current;
 
-    ext_filename = malloc(strlen(base_name) + 6); /* +5 for ".ext" +1 for null */
-    if (!ext_filename)
+    for (current = ctx->entry_list; current; current = current->next)
     {
-        free(base_name);
-        return FALSE;
-    }
-    sprintf(ext_filename, "%s.ext", base_name);
-
-    /* Open file for writing */
-    file = fopen(ext_filename, "w");
-    if (!file)
-    {
-        printf("Error: Cannot create externals file %s\n", ext_filename);
-        free(base_name);
-        free(ext_filename);
-        return FALSE;
-    }
-
-    /* Write each external reference */
-    current = ext_list;
-    while (current)
-    {
-        address_base4 = decimal_to_base4(current->address, 4);
-        if (!address_base4)
-        {
-            printf("Error: Failed to convert external address to base 4\n");
-            fclose(file);
-            free(base_name);
-            free(ext_filename);
+        if (!put_symbol_line(out, current->symbol_name, current->address))
             return FALSE;
-        }
-
-        fprintf(file, "%s %s\n", current->symbol_name, address_base4);
-        free(address_base4);
-        current = current->next;
     }
 
-    fclose(file);
-    free(base_name);
-    free(ext_filename);
-
-    printf("Generated externals file: %s\n", ext_filename);
     return TRUE;
 }
 
-/* Get base filename without extension */
-char *get_base_filename(const char *filename)
+/* Format the .ext file (empty when there are no external references) */
+Boolean format_externals_file(const AssemblerContext *ctx, TextBuffer *out)
 {
-    char *base_name;
-    char *dot_pos;
-    int len;
-
-    if (!filename)
-        return NULL;
+    const ExtRef *current;
 
-    /* Find last dot in filename */
-    dot_pos = strrchr(filename, '.');
-    if (dot_pos)
-    {
-        len = dot_pos - filename;
-    }
-    else
+    for (current = ctx->ext_list; current; current = current->next)
     {
-        len = strlen(filename);
+        if (!put_symbol_line(out, current->symbol_name, current->address))
+            return FALSE;
     }
 
-    base_name = malloc(len + 1);
-    if (!base_name)
-        return NULL;
-
-    strncpy(base_name, filename, len);
-    base_name[len] = '\0';
-
-    return base_name;
+    return TRUE;
 }
 
 /* Count entries in list */
-int count_entries(EntryPoint *list)
+int count_entries(const EntryPoint *list)
 {
     int count = 0;
-    EntryPoint *current = list;
+    const EntryPoint *current = list;
 
     while (current)
     {
@@ -341,10 +144,10 @@ int count_entries(EntryPoint *list)
 }
 
 /* Count externals in list */
-int count_externals(ExtRef *list)
+int count_externals(const ExtRef *list)
 {
     int count = 0;
-    ExtRef *current = list;
+    const ExtRef *current = list;
 
     while (current)
     {
@@ -1,153 +1,233 @@
 
 #include "preassembler.h"
+#include "text_buffer.h"
+#include "line_parser.h"
+#include "instruction_validation.h"
+#include "console.h"
+
+/* Where the body of a macro is: in the macro table's text, or in the
+   mapped library for --macro-lib macros */
+static const char *macro_body(const GenericTable *table, const MacroData *macro)
+{
+    return macro->body ? macro->body : table->text.data + macro->offset;
+}
 
-void cleanup_macro_lines(char **lines, int count)
+/* Parse the body of a macro once, for every call to share. Instructions
+   are validated here as well, with the messages discarded; labeled lines
+   and instructions that fail get no statement, so every copy of them is
+   checked, and reported, on its own line. */
+static void parse_macro_statements(Arena *arena, const GenericTable *table, MacroData *macro)
 {
-    int i;
-    if (!lines)
+    const char *body = macro_body(table, macro);
+    const char *end;
+    char line[MAX_LINE_LENGTH + 1];
+    ConsoleCapture discard;
+    ConsoleCapture *previous = get_console_capture();
+    size_t position;
+    int line_count = 0;
+
+    macro->parsed = TRUE;
+
+    /* every body line ends with a newline */
+    for (position = 0; position < macro->length; position = (size_t)(end - body) + 1)
+    {
+        end = memchr(body + position, '\n', macro->length - position);
+        line_count++;
+    }
+
+    macro->statements = arena_alloc(arena, line_count * sizeof(MacroStatement));
+    if (!macro->statements)
         return;
 
-    for (i = 0; i < count; i++)
+    init_console_capture(&discard);
+    set_console_capture(&discard);
+    for (position = 0; position < macro->length; position = (size_t)(end - body) + 1)
     {
-        if (lines[i])
-        {
-            free(lines[i]);
-        }
+        size_t length;
+        ParsedLine *parsed;
+
+        end = memchr(body + position, '\n', macro->length - position);
+        length = (size_t)(end - body) + 1 - position;
+        parsed = arena_alloc(arena, sizeof(ParsedLine));
+        if (!parsed || length > MAX_LINE_LENGTH)
+            continue;
+
+        memcpy(line, body + position, length);
+        line[length] = '\0';
+        parse_source_line(line, 0, parsed);
+        if (parsed->has_label)
+            continue;
+        if (parsed->kind == LINE_INSTRUCTION && !validate_command_line(line, 0))
+            continue;
+
+        macro->statements[macro->statement_count].offset = position;
+        macro->statements[macro->statement_count].parsed = parsed;
+        macro->statement_count++;
     }
-    free(lines);
+    set_console_capture(previous);
+    free_console_capture(&discard);
 }
 
-Boolean preassembler(const char *filename)
+/* Append the body of a macro call with one copy out of the macro
+   table's text, and record the call with its pre-parsed statements. The
+   body is parsed at its first call, so macros that are never called cost
+   nothing. After a label the first line is not the bare statement, so it
+   is left to the first pass. */
+static Boolean emit_macro_body(AssemblerContext *ctx, TextBuffer *output, const GenericTable *table,
+                               MacroData *macro, Boolean labeled)
 {
+    const MacroStatement *statements;
+    int statement_count;
+
+    if (!macro->parsed)
+        parse_macro_statements(&ctx->arena, table, macro);
 
-    /* File handling setup */
-    char *input_name = create_filename_with_extension(filename, AS_EXTENSION);
-    FILE *input = fopen(input_name, "r");
-    char *output_name = create_filename_with_extension(filename, AM_EXTENSION);
-    FILE *output = fopen(output_name, "w");
+    statements = macro->statements;
+    statement_count = macro->statement_count;
+    if (labeled && statement_count > 0 && statements[0].offset == 0)
+    {
+        statements++;
+        statement_count--;
+    }
 
-    GenericTable *macro_table = create_macro_table();
-    GenericTable *label_table = create_label_table();
+    if (statement_count > 0 && !add_macro_splice(ctx, output->length, statements, statement_count))
+        return FALSE;
+
+    return append_to_text_buffer(output, macro_body(table, macro), macro->length);
+}
+
+/* Expand the macros of source (the contents of a .as file) into output */
+Boolean preassembler(AssemblerContext *ctx, const TextBuffer *source, TextBuffer *output)
+{
+    GenericTable *macro_table = create_macro_table(&ctx->arena);
+    Boolean success;
+
+    if (!macro_table)
+    {
+        print_error(MEMORY_ALLOCATION_ERROR, 0, "Failed to create macro or label table");
+        return FALSE;
+    }
+
+    /* --macro-lib macros behave as if defined before the source */
+    macro_table->library = ctx->macro_library;
+    success = expand_macros(ctx, source, output, macro_table);
+    free_macro_table(macro_table);
+    return success;
+}
+
+/* The pre-assembler proper; the macros defined by source are left in
+   macro_table (a macro library is built from them) */
+Boolean expand_macros(AssemblerContext *ctx, const TextBuffer *source, TextBuffer *output,
+                      GenericTable *macro_table)
+{
+    size_t position = 0; /* read offset in source */
+
+    GenericTable *label_table = create_label_table(&ctx->arena);
     MacroData *macro_data = NULL;
 
     /* Processing state variables */
+    LineSpan span; /* current line, in place in the source */
     char line[MAX_LINE_LENGTH];
+    size_t line_length; /* of line, newline included */
     int line_number;
     Boolean inside_macro = FALSE; /* Track if we're inside macro definition */
     Boolean inside_macro_definition = FALSE;
     Boolean has_errors = FALSE;
+    Boolean out_of_memory = FALSE;
 
-    /* Temporary storage for current macro being defined */
+    /* Current macro being defined - its lines go straight into the macro
+       table's text, where the body starts at macro_start */
     char current_macro_name[MAX_LABEL_LENGTH];
-    char **macro_lines = NULL;
-    int macro_capacity = 0;
-    int macro_line_count;
-
-    char *first_word = NULL;
-    char *macro_name = NULL;
-    char **macro_content = NULL; /* This will be dynamically allocated for each macro */
+    size_t macro_start = 0;
+
+    /* Words of the current line - views into line, copied only when a
+       table lookup needs a terminated string */
+    LineTokens tokens;
+    char first_word[MAX_LINE_LENGTH];
+    char macro_name[MAX_LINE_LENGTH];
+    char label_name[MAX_LINE_LENGTH];
+    char word_after_label[MAX_LINE_LENGTH];
     MacroNode *macro = NULL;
 
-    char *label_name = NULL;
-    char *content_after_label = NULL;
-    char *first_word_after_label = NULL;
-
-    int i, j, c, k;
-    int len;
-
     line_number = 0;
-    macro_line_count = 0;
-
-    if (!input)
-    {
-        REPORT_CRITICAL_ERROR_AND_EXIT(FILE_ERROR, 0, "Cannot open input file", input_name, NULL);
-    }
-
-    if (!output)
-    {
-        fclose(input);
-        REPORT_CRITICAL_ERROR_AND_EXIT(FILE_ERROR, 0, "Cannot create output file", input_name, output_name);
-    }
-
-    /* Initialize macro table */
-    if (!macro_table)
-    {
-        fclose(input);
-        if (output)
-            fclose(output);
-        REPORT_CRITICAL_ERROR_AND_EXIT(MEMORY_ALLOCATION_ERROR, 0, "Failed to create macro table", input_name, output_name);
-    }
+    ctx->splice_count = 0;
 
-    /* Initialize label table */
+    /* Initialize the tables */
     if (!label_table)
     {
-        fclose(input);
-        fclose(output);
-        free_macro_table(macro_table); /* Free only the successfully allocated macro_table */
-        REPORT_CRITICAL_ERROR_AND_EXIT(MEMORY_ALLOCATION_ERROR, 0, "Failed to create label table", input_name, output_name);
+        print_error(MEMORY_ALLOCATION_ERROR, 0, "Failed to create macro or label table");
+        return FALSE;
     }
 
-    /* Main processing loop - read line by line */
-    while (fgets(line, sizeof(line), input) != NULL)
+    /* Main processing loop - walk the source line by line */
+    while (next_line_span(source, &position, &span))
     {
 
         line_number++;
 
-        if (is_line_too_long(line, line_number, input))
+        if (is_line_too_long(&span, line_number))
         {
             has_errors = TRUE;
-            while ((c = fgetc(input)) != '\n' && c != EOF)
-            {
-                /* Skip the rest of the line */
-            };
             continue;
         }
+        /* every line carries its newline from here on, so storing or
+           expanding it needs neither strlen nor a newline check */
+        copy_line_span(&span, line);
+        line_length = span.length + 1;
+        if (!span.newline)
+        {
+            line[span.length] = '\n';
+            line[line_length] = '\0';
+        }
 
         if (is_empty_line(line) || is_comment_line(line))
         {
             continue;
         }
 
-        /* Parse first word of line to determine action */
-        first_word = get_first_word(line); /* Fixed: removed * */
+        /* Split the line once; the first word determines the action */
+        tokenize_line(line, &tokens);
+        first_word[0] = '\0';
+        if (tokens.word_count > 0)
+            span_to_string(line, tokens.words[0], first_word);
 
         /* STATE 1: Check for macro/Label definition start */
 
-        if (first_word && strcmp(first_word, MACRO_START) == 0)
+        if (strcmp(first_word, MACRO_START) == 0)
         {
             inside_macro_definition = TRUE;
 
             /* Extract macro name from line */
-            macro_name = get_second_word(line);
-            if (!macro_name)
+            if (tokens.word_count < 2)
             {
-                REPORT_ERROR_AND_CONTINUE(MACRO_ERROR, line_number, "Missing macro name", first_word, NULL);
+                REPORT_ERROR_AND_CONTINUE(MACRO_ERROR, line_number, "Missing macro name", NULL, NULL);
             }
+            span_to_string(line, tokens.words[1], macro_name);
 
-            if (has_extraneous_text_after_words(line, 2))
+            if (tokens.word_count > 2)
             {
-                REPORT_ERROR_AND_CONTINUE(EXTRANEOUS_TEXT, line_number, "Extra text after macro name", first_word, macro_name);
+                REPORT_ERROR_AND_CONTINUE(EXTRANEOUS_TEXT, line_number, "Extra text after macro name", NULL, NULL);
             }
 
             /* Validate macro name according to project rules */
             if (!is_valid_macro_name(macro_name))
             {
-                REPORT_ERROR_AND_CONTINUE(INVALID_MACRO_NAME, line_number, "Invalid macro name", first_word, macro_name);
+                REPORT_ERROR_AND_CONTINUE(INVALID_MACRO_NAME, line_number, "Invalid macro name", NULL, NULL);
             }
 
             if (is_reserved_word(macro_name))
             {
-                REPORT_ERROR_AND_CONTINUE(INVALID_MACRO_NAME, line_number, "Macro name is reserved word", first_word, macro_name);
+                REPORT_ERROR_AND_CONTINUE(INVALID_MACRO_NAME, line_number, "Macro name is reserved word", NULL, NULL);
             }
 
             if (is_label_already_defined(label_table, macro_name))
             {
-                REPORT_ERROR_AND_CONTINUE(INVALID_MACRO_NAME, line_number, "Macro name cannot be label name", first_word, macro_name);
+                REPORT_ERROR_AND_CONTINUE(INVALID_MACRO_NAME, line_number, "Macro name cannot be label name", NULL, NULL);
             }
 
             if (find_macro(macro_table, macro_name))
             {
-                REPORT_ERROR_AND_CONTINUE(DUPLICATE_MACRO_NAME, line_number, "Macro already defined", first_word, macro_name);
+                REPORT_ERROR_AND_CONTINUE(DUPLICATE_MACRO_NAME, line_number, "Macro already defined", NULL, NULL);
             }
 
             /* Start macro collection mode */
@@ -156,226 +236,110 @@ Boolean preassembler(const char *filename)
             {
                 strcpy(current_macro_name, macro_name);
                 inside_macro = TRUE;
-
-                /* Clean up previous macro if exists */
-                if (macro_lines)
-                {
-                    cleanup_macro_lines(macro_lines, macro_line_count);
-                }
-
-                macro_line_count = 0;
-                macro_capacity = 10;
-                macro_lines = malloc(macro_capacity * sizeof(char *));
+                macro_start = macro_table->text.length;
             }
 
-            free(first_word);
-            /*if (macro_name)*/
-            free(macro_name);
             continue;
         }
 
         /* STATE 2: Check for macro definition end */
 
-        if (first_word && strcmp(first_word, MACRO_END) == 0)
+        if (strcmp(first_word, MACRO_END) == 0)
         {
             inside_macro_definition = FALSE;
 
-            if (has_extraneous_text_after_words(line, 1))
+            if (tokens.word_count > 1)
             {
-                REPORT_ERROR_AND_CONTINUE(EXTRANEOUS_TEXT, line_number, "Extra text after mcroend", first_word, NULL);
+                REPORT_ERROR_AND_CONTINUE(EXTRANEOUS_TEXT, line_number, "Extra text after mcroend", NULL, NULL);
             }
 
             if (inside_macro)
             {
-                /* Prepare macro content for storage */
-                macro_content = malloc(macro_line_count * sizeof(char *));
-                if (!macro_content)
-                {
-                    REPORT_CRITICAL_ERROR_AND_EXIT(MEMORY_ALLOCATION_ERROR, line_number, "Failed to allocate macro", first_word, NULL);
-                }
-
-                /* Create array of pointers to macro lines */
-                for (i = 0; i < macro_line_count; i++)
-                {
-                    macro_content[i] = malloc(strlen(macro_lines[i]) + 1);
-                    if (!macro_content[i])
-                    {
-                        /* Clean up on allocation failure */
-                        for (k = 0; k < i; k++)
-                        {
-                            free(macro_content[k]);
-                        }
-                        free(macro_content);
-                        REPORT_CRITICAL_ERROR_AND_EXIT(MEMORY_ALLOCATION_ERROR, line_number, "Failed to allocate macro line", first_word, NULL);
-                    }
-                    strcpy(macro_content[i], macro_lines[i]);
-                }
-
-                /* Add completed macro to table */
-                if (!add_macro(macro_table, current_macro_name, macro_content, macro_line_count))
+                /* Add completed macro to table - it keeps where its body is */
+                if (!add_macro(macro_table, current_macro_name, macro_start,
+                               macro_table->text.length - macro_start))
                 {
                     REPORT_ERROR_ONLY(MACRO_ERROR, line_number, "Failed to add macro", NULL, NULL);
-                    /* Clean up allocated content */
-                    for (i = 0; i < macro_line_count; i++)
-                    {
-                        free(macro_content[i]);
-                    }
-                    free(macro_content);
-                    free(first_word);
                     continue;
                 }
-
-                /* Clean up temporary allocation */
-                for (i = 0; i < macro_line_count; i++)
-                {
-                    free(macro_content[i]);
-                }
-                free(macro_content);
-                macro_content = NULL;
             }
 
             inside_macro = FALSE;
-            free(first_word);
             continue;
         }
 
         if (inside_macro_definition && !inside_macro)
         {
-            free(first_word);
             continue;
         }
 
-        if (has_label(line))
+        if (tokens.has_label)
         {
-            label_name = extract_label_name(line);
-            content_after_label = get_content_after_label(line);
-            first_word_after_label = get_first_word(content_after_label);
-
-            if (label_name)
+            /* labeled lines are kept without trailing whitespace */
+            trim_whitespace(line);
+            line_length = strlen(line);
+            line[line_length++] = '\n';
+            line[line_length] = '\0';
+            span_to_string(line, tokens.label, label_name);
+
+            if (!is_valid_label_name(label_name))
             {
-                if (!is_valid_label_name(label_name))
-                {
-                    REPORT_ERROR_ONLY(INVALID_LABEL_NAME, line_number, "Invalid label name", label_name, content_after_label);
-                    free(first_word);
-                    if (first_word_after_label)
-                        free(first_word_after_label);
-                    continue;
-                }
-
-                if (is_reserved_word(label_name))
-                {
-                    REPORT_ERROR_ONLY(INVALID_LABEL_NAME, line_number, "Label cannot be reserved word", label_name, content_after_label);
-                    free(first_word);
-                    if (first_word_after_label)
-                        free(first_word_after_label);
-                    continue;
-                }
+                REPORT_ERROR_ONLY(INVALID_LABEL_NAME, line_number, "Invalid label name", NULL, NULL);
+                continue;
+            }
 
-                if (find_macro(macro_table, label_name))
-                {
-                    REPORT_ERROR_ONLY(INVALID_LABEL_NAME, line_number, "Label cannot be macro name", label_name, content_after_label);
-                    free(first_word);
-                    if (first_word_after_label)
-                        free(first_word_after_label);
-                    continue;
-                }
+            if (is_reserved_word(label_name))
+            {
+                REPORT_ERROR_ONLY(INVALID_LABEL_NAME, line_number, "Label cannot be reserved word", NULL, NULL);
+                continue;
+            }
 
-                if (is_label_already_defined(label_table, label_name))
-                {
-                    REPORT_ERROR_ONLY(DUPLICATE_LABEL_NAME, line_number, "Label already defined", label_name, content_after_label);
-                    free(first_word);
-                    if (first_word_after_label)
-                        free(first_word_after_label);
-                    continue;
-                }
+            if (find_macro(macro_table, label_name))
+            {
+                REPORT_ERROR_ONLY(INVALID_LABEL_NAME, line_number, "Label cannot be macro name", NULL, NULL);
+                continue;
+            }
 
-                if (first_word_after_label &&
-    (strcmp(first_word_after_label, MACRO_START) == 0 ||
-     strcmp(first_word_after_label, MACRO_END) == 0))
-{
-    REPORT_ERROR_ONLY(LABEL_ON_MACRO_LINE, line_number, "Label not allowed on macro line", label_name, content_after_label);
-    free(first_word);
-    if (first_word_after_label)
-        free(first_word_after_label);
-    continue;
-}
+            if (is_label_already_defined(label_table, label_name))
+            {
+                REPORT_ERROR_ONLY(DUPLICATE_LABEL_NAME, line_number, "Label already defined", NULL, NULL);
+                continue;
+            }
 
-                if (!add_label_to_table(label_table, label_name, line_number))
-                {
-                    REPORT_CRITICAL_ERROR_AND_EXIT(MEMORY_ALLOCATION_ERROR, line_number, "Failed to add label to table", label_name, content_after_label);
-                }
+            if (span_equals(line, tokens.after_label, MACRO_START) ||
+                span_equals(line, tokens.after_label, MACRO_END))
+            {
+                REPORT_ERROR_ONLY(LABEL_ON_MACRO_LINE, line_number, "Label not allowed on macro line", NULL, NULL);
+                continue;
             }
 
-            if (label_name)
-                free(label_name);
-            if (content_after_label)
-                free(content_after_label);
-            if (first_word_after_label)
-                free(first_word_after_label);
+            if (!add_label_to_table(label_table, label_name, line_number))
+            {
+                /* out of memory: this file fails, the caller (maybe a daemon) goes on */
+                REPORT_ERROR_ONLY(MEMORY_ALLOCATION_ERROR, line_number, "Failed to add label to table", NULL, NULL);
+                continue;
+            }
         }
 
         /* STATE 3: Inside macro definition - collect lines */
         if (inside_macro)
         {
-            /* Store line in temporary macro content */
-            /* Check if we need to expand */
-            if (macro_line_count >= macro_capacity)
-            {
-                char **new_lines;
-                macro_capacity *= 2;
-                new_lines = realloc(macro_lines, macro_capacity * sizeof(char *));
-                if (!new_lines)
-                {
-                    print_error(MEMORY_ALLOCATION_ERROR, line_number, "Failed to expand macro storage");
-                    cleanup_macro_lines(macro_lines, macro_line_count);
-                    macro_lines = NULL;
-                    has_errors = TRUE;
-                    free(first_word);
-                    continue;
-                }
-                macro_lines = new_lines;
-            }
-
-            /* Allocate and copy line */
-            macro_lines[macro_line_count] = malloc(strlen(line) + 1);
-            if (!macro_lines[macro_line_count])
+            /* Store the line once, in the macro table's text */
+            if (!add_macro_line(macro_table, line, line_length))
             {
                 print_error(MEMORY_ALLOCATION_ERROR, line_number, "Failed to allocate macro line");
-                cleanup_macro_lines(macro_lines, macro_line_count);
-                macro_lines = NULL;
                 has_errors = TRUE;
-                free(first_word);
                 continue;
             }
 
-            strcpy(macro_lines[macro_line_count], line);
-            len = strlen(line);
-
-            if (len > 0 && line[len - 1] != '\n')
-            {
-                macro_lines[macro_line_count] = realloc(macro_lines[macro_line_count], len + 2);
-                if (!macro_lines[macro_line_count])
-                {
-                    print_error(MEMORY_ALLOCATION_ERROR, line_number, "Failed to expand macro line");
-                    cleanup_macro_lines(macro_lines, macro_line_count);
-                    macro_lines = NULL;
-                    has_errors = TRUE;
-                    free(first_word);
-                    continue;
-                }
-                strcat(macro_lines[macro_line_count], "\n");
-            }
-
-            macro_line_count++;
-            free(first_word);
             continue;
         }
 
         /* STATE 4: Regular processing - check for macro calls or copy line */
-        macro = find_macro(macro_table, first_word); /* Fixed: removed * */
+        macro = find_macro(macro_table, first_word);
         if (macro)
         {
-            if (has_extraneous_text_after_words(line, 1))
+            if (tokens.word_count > 1)
             {
                 print_error(EXTRANEOUS_TEXT, line_number, "Extra text after macro call");
                 has_errors = TRUE;
@@ -383,115 +347,59 @@ Boolean preassembler(const char *filename)
             else
             {
                 macro_data = (MacroData *)macro->data;
-                if (macro_data)
-                {
-                    for (j = 0; j < macro_data->line_count; j++)
-                    {
-                        fputs(macro_data->content[j], output);
-                        len = strlen(macro_data->content[j]);
-                        if (len > 0 && macro_data->content[j][len - 1] != '\n')
-                        {
-                            fputc('\n', output);
-                        }
-                    }
-                }
+                ctx->macros_expanded++;
+                if (macro_data && !emit_macro_body(ctx, output, macro_table, macro_data, FALSE))
+                    out_of_memory = TRUE;
             }
         }
         else
         {
             /* Check if this line has a label followed by a macro call */
-            if (has_label(line))
+            macro = NULL;
+            if (tokens.has_label && tokens.after_label.length > 0)
             {
-                char *line_label = extract_label_name(line);
-                char *line_content = get_content_after_label(line);
-                char *word_after_label = NULL;
-                
-                if (line_content)
-                {
-                    word_after_label = get_first_word(line_content);
-                }
-                
-                /* Check if the word after label is a macro */
-                if (word_after_label && find_macro(macro_table, word_after_label))
-                {
-                    macro = find_macro(macro_table, word_after_label);
-                    macro_data = (MacroData *)macro->data;
-                    
-                    if (macro_data && macro_data->line_count > 0)
-                    {
-                        /* Write label with first line of macro */
-                        fprintf(output, "%s: %s", line_label, macro_data->content[0]);
-                        len = strlen(macro_data->content[0]);
-                        if (len > 0 && macro_data->content[0][len - 1] != '\n')
-                        {
-                            fputc('\n', output);
-                        }
-                        
-                        /* Write remaining lines of macro */
-                        for (j = 1; j < macro_data->line_count; j++)
-                        {
-                            fputs(macro_data->content[j], output);
-                            len = strlen(macro_data->content[j]);
-                            if (len > 0 && macro_data->content[j][len - 1] != '\n')
-                            {
-                                fputc('\n', output);
-                            }
-                        }
-                    }
-                }
-                else
+                span_to_string(line, tokens.after_label, word_after_label);
+                macro = find_macro(macro_table, word_after_label);
+            }
+
+            if (macro)
+            {
+                macro_data = (MacroData *)macro->data;
+                ctx->macros_expanded++;
+
+                if (macro_data && macro_data->length > 0)
                 {
-                    /* Not a macro call - copy line as-is */
-                    fputs(line, output);
-                    len = strlen(line);
-                    if (len > 0 && line[len - 1] != '\n')
-                    {
-                        fputc('\n', output);
-                    }
+                    /* Write label with first line of macro */
+                    if (!append_to_text_buffer(output, line + tokens.label.start, tokens.label.length) ||
+                        !append_to_text_buffer(output, ": ", 2))
+                        out_of_memory = TRUE;
+
+                    /* Write the macro lines */
+                    if (!emit_macro_body(ctx, output, macro_table, macro_data, TRUE))
+                        out_of_memory = TRUE;
                 }
-                
-                /* Cleanup */
-                if (line_label) free(line_label);
-                if (line_content) free(line_content);
-                if (word_after_label) free(word_after_label);
             }
             else
             {
-                /* Regular line - copy as-is to output */
-                fputs(line, output);
-                len = strlen(line);
-                if (len > 0 && line[len - 1] != '\n')
-                {
-                    fputc('\n', output);
-                }
+                /* Not a macro call - copy line as-is */
+                if (!append_to_text_buffer(output, line, line_length))
+                    out_of_memory = TRUE;
             }
         }
 
-        if (first_word)
-            free(first_word);
+        if (out_of_memory)
+        {
+            print_error(MEMORY_ALLOCATION_ERROR, line_number, "Failed to store expanded line");
+            has_errors = TRUE;
+            break;
+        }
     }
 
+    ctx->lines_read = line_number;
+    ctx->labels_defined = label_table->count;
+
     /* Cleanup resources */
-    if (macro_table)
-        free_macro_table(macro_table);
-    if (label_table)
-        free_label_table(label_table);
-    cleanup_macro_lines(macro_lines, macro_line_count);
-    macro_lines = NULL;
-    macro_capacity = 0;
-    if (input)
-        fclose(input);
-    if (output)
-        fclose(output);
-    if (input_name)
-        free(input_name);
-
-    if (has_errors && output_name && file_exists(output_name))
-    {
-        remove(output_name);
-    }
+    free_label_table(label_table);
 
-    if (output_name)
-        free(output_name);
     return !has_errors;
-} /* End of preassembler function */
\ No newline at end of file
+} /* End of expand_macros function */
@@ -2,6 +2,8 @@
 #define PREASSEMBLER_H
 
 #include "assembler.h"
+#include "types.h"
+#include "context.h"
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -24,17 +26,40 @@ typedef struct GenericNode
 
 typedef struct
 {
+    Arena *arena; /* nodes, names and data are allocated here */
     GenericNode *head;
     int count;
+    GenericNode **index; /* open-addressing index over the list (linear probing) */
+    int index_capacity;  /* power of two, kept above twice the count */
+    TextBuffer text;     /* macro tables: the body text of every macro, stored once */
+    const struct AsmMacroLibrary *library; /* macro tables: searched after the table (--macro-lib) */
 } GenericTable;
 
-/* Macro-specific data structure */
+/* Macro-specific data structure - the body is a run of whole lines,
+   newlines included, in the table's text. Offsets stay valid while
+   the text grows. */
 typedef struct
 {
-    char **content;
-    int line_count;
+    const char *body; /* --macro-lib macros: the body in the mapped library */
+    size_t offset;    /* otherwise: where the body starts in the table's text */
+    size_t length;
+    MacroStatement *statements; /* made at the first call; other lines are parsed per copy */
+    int statement_count;
+    Boolean parsed;             /* statements have been made */
 } MacroData;
 
+/* Words of one source line, as offsets into the line buffer */
+#define MAX_LINE_WORDS 2
+
+typedef struct
+{
+    TextSpan words[MAX_LINE_WORDS]; /* the first words of the line */
+    int word_count;                 /* number of words on the whole line */
+    Boolean has_label;              /* text before a ':' that does not start the line */
+    TextSpan label;                 /* label name, trimmed */
+    TextSpan after_label;           /* first word after the ':' (empty if none) */
+} LineTokens;
+
 /* Type aliases for clarity */
 typedef GenericTable MacroTable;
 typedef GenericTable LabelTable;
@@ -44,69 +69,52 @@ typedef GenericNode LabelNode;
 /* FUNCTION PROTOTYPES */
 
 /* Generic table functions */
-GenericTable *create_generic_table(void);
+GenericTable *create_generic_table(Arena *arena);
 void free_generic_table(GenericTable *table, void (*cleanup_data)(void *));
 Boolean add_to_generic_table(GenericTable *table, const char *name, int line_number, void *data);
 GenericNode *find_in_generic_table(GenericTable *table, const char *name);
 
 /* Specific table implementations */
-GenericTable *create_macro_table(void);
+GenericTable *create_macro_table(Arena *arena);
 void free_macro_table(GenericTable *table);
-Boolean add_macro(GenericTable *table, const char *name, char **content, int line_count);
+Boolean add_macro_line(GenericTable *table, const char *line, size_t length);
+Boolean add_macro(GenericTable *table, const char *name, size_t offset, size_t length);
 GenericNode *find_macro(GenericTable *table, const char *name);
 Boolean is_macro_name(GenericTable *table, const char *name);
 
-GenericTable *create_label_table(void);
+GenericTable *create_label_table(Arena *arena);
 void free_label_table(GenericTable *table);
 Boolean add_label_to_table(GenericTable *table, const char *name, int line_number);
 Boolean is_label_already_defined(GenericTable *table, const char *name);
 
 /* String utilities */
-char *extract_until_char(const char *line, char delimiter);
-char *get_content_after_char(const char *line, char delimiter);
 Boolean is_valid_name(const char *name, Boolean allow_underscore);
 
 /* Label processing functions */
-Boolean has_label(const char *line);
-char *extract_label_name(const char *line);
-char *get_content_after_label(const char *line);
 Boolean is_valid_label_name(const char *name);
 Boolean is_valid_macro_name(const char *name);
 
-/* Basic string processing functions */
-char *get_first_word(const char *line);
-char *get_second_word(const char *line);
-Boolean has_extraneous_text_after_words(const char *line, int expected_words);
+/* Line tokenizer - spans into the line, no allocation */
+void tokenize_line(const char *line, LineTokens *tokens);
+char *span_to_string(const char *line, TextSpan span, char *buffer);
+Boolean span_equals(const char *line, TextSpan span, const char *word);
 
 /* File utilities */
 Boolean file_exists(const char *filename);
-void cleanup_and_exit(MacroTable *table, FILE *input, FILE *output);
-void cleanup_macro_lines(char **lines, int count);
-char *create_filename_with_extension(const char *base_name, const char *extension);
+char *create_filename_with_extension(Arena *arena, const char *base_name, const char *extension);
 
 /* Line processing functions */
 Boolean is_empty_line(const char *line);
 Boolean is_comment_line(const char *line);
-Boolean is_line_too_long(const char *line, int line_number, FILE *input);
 char *trim_whitespace(char *str);
 Boolean is_reserved_word(const char *word);
 
-/* Main preassembler function */
-Boolean preassembler(const char *filename);
+/* Main preassembler function - expands the source text into output */
+Boolean preassembler(AssemblerContext *ctx, const TextBuffer *source, TextBuffer *output);
+Boolean expand_macros(AssemblerContext *ctx, const TextBuffer *source, TextBuffer *output,
+                      GenericTable *macro_table);
 
 /* Error handling macros */
-#define REPORT_CRITICAL_ERROR_AND_EXIT(error_type, line_num, msg, ptr1, ptr2) \
-    print_error(error_type, line_num, msg);                                   \
-    if (ptr1)                                                                 \
-    {                                                                         \
-        free(ptr1);                                                           \
-    }                                                                         \
-    if (ptr2)                                                                 \
-    {                                                                         \
-        free(ptr2);                                                           \
-    }                                                                         \
-    exit(1)
-
 #define REPORT_ERROR_AND_CONTINUE(error_type, line_num, msg, ptr1, ptr2) \
     print_error(error_type, line_num, msg);                              \
     has_errors = TRUE;                                                   \
@@ -145,4 +153,4 @@ Boolean preassembler(const char *filename);
         free(ptr2);                                              \
     }
 
-#endif /* PREASSEMBLER_H */
\ No newline at end of file
+#endif /* PREASSEMBLER_H */
\ No newline at end of file
@@ -0,0 +1,524 @@
+/**
+ * @file serve.c
+ * @brief Assembler daemon (--serve) and client (--client) over a Unix socket
+ *
+ * The daemon keeps one AsmSession for its whole life: the instruction
+ * and keyword tables are static, and the session keeps an arena block
+ * and the symbol index allocated between requests. Each request is
+ * assembled with the console captured, and the captured output is sent
+ * back so the client can print it as if it had assembled the file
+ * itself. The protocol is described in serve.h.
+ */
+
+/* for sockets, sigaction and lstat under -ansi */
+#define _POSIX_C_SOURCE 200112L
+
+#include "serve.h"
+#include "text_buffer.h"
+#include "console.h"
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define SERVE_BACKLOG 16
+#define SERVE_CHUNK_SIZE 16384
+#define SERVE_REQUEST_HEADER 7 /* kind, log level, flags, max errors */
+#define SERVE_RESPONSE_HEADER 9 /* status, errors, run count */
+#define SERVE_STATS_COUNTERS 6 /* AsmStats counters after the phase times */
+
+/* set by SIGINT/SIGTERM; the daemon finishes the current request and exits */
+static volatile sig_atomic_t stop_serving = 0;
+
+static void request_stop(int signal_number)
+{
+    (void)signal_number;
+    stop_serving = 1;
+}
+
+/* Append a 4-byte big-endian number */
+static Boolean put_u32(TextBuffer *buffer, unsigned long value)
+{
+    char bytes[4];
+
+    bytes[0] = (char)((value >> 24) & 0xFF);
+    bytes[1] = (char)((value >> 16) & 0xFF);
+    bytes[2] = (char)((value >> 8) & 0xFF);
+    bytes[3] = (char)(value & 0xFF);
+    return append_to_text_buffer(buffer, bytes, 4);
+}
+
+static unsigned long get_u32(const char *data)
+{
+    const unsigned char *bytes = (const unsigned char *)data;
+
+    return ((unsigned long)bytes[0] << 24) | ((unsigned long)bytes[1] << 16) |
+           ((unsigned long)bytes[2] << 8) | (unsigned long)bytes[3];
+}
+
+static Boolean write_all(int fd, const char *data, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t written = write(fd, data, length);
+        if (written < 0)
+        {
+            if (errno == EINTR && !stop_serving)
+                continue;
+            return FALSE;
+        }
+        data += written;
+        length -= written;
+    }
+    return TRUE;
+}
+
+/* Read exactly length bytes; FALSE at the end of the stream or on error */
+static Boolean read_all(int fd, char *data, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t count = read(fd, data, length);
+        if (count < 0 && errno == EINTR && !stop_serving)
+            continue;
+        if (count <= 0)
+            return FALSE;
+        data += count;
+        length -= count;
+    }
+    return TRUE;
+}
+
+/* Send one frame: the length, then the payload */
+Boolean send_frame(int fd, const char *data, size_t length)
+{
+    char header[4];
+
+    header[0] = (char)((length >> 24) & 0xFF);
+    header[1] = (char)((length >> 16) & 0xFF);
+    header[2] = (char)((length >> 8) & 0xFF);
+    header[3] = (char)(length & 0xFF);
+    return write_all(fd, header, 4) && write_all(fd, data, length);
+}
+
+/* Receive one frame into payload, replacing its contents; FALSE at the
+   end of the stream, on error or for a frame over SERVE_MAX_FRAME */
+Boolean receive_frame(int fd, TextBuffer *payload)
+{
+    char header[4];
+    char chunk[SERVE_CHUNK_SIZE];
+    unsigned long remaining;
+
+    payload->length = 0;
+    if (!read_all(fd, header, 4))
+        return FALSE;
+
+    remaining = get_u32(header);
+    if (remaining > SERVE_MAX_FRAME || !append_to_text_buffer(payload, "", 0))
+        return FALSE;
+
+    while (remaining > 0)
+    {
+        size_t count = remaining < sizeof(chunk) ? remaining : sizeof(chunk);
+        if (!read_all(fd, chunk, count) || !append_to_text_buffer(payload, chunk, count))
+            return FALSE;
+        remaining -= count;
+    }
+    return TRUE;
+}
+
+/* Encode an assemble request (see serve.h) */
+Boolean build_request(TextBuffer *request, int kind, int flags, const char *name,
+                      const char *src, size_t len, int max_errors)
+{
+    char header[3];
+
+    header[0] = (char)kind;
+    header[1] = (char)log_level;
+    header[2] = (char)flags;
+    request->length = 0;
+    return append_to_text_buffer(request, header, 3) &&
+           put_u32(request, (unsigned long)max_errors) &&
+           append_to_text_buffer(request, name, strlen(name) + 1) &&
+           (len == 0 || append_to_text_buffer(request, src, len));
+}
+
+/* Append one optional text of a response */
+static Boolean put_text(TextBuffer *response, const AsmText *text)
+{
+    if (!text->data)
+        return put_u32(response, SERVE_NO_TEXT);
+    return put_u32(response, (unsigned long)text->length) &&
+           append_to_text_buffer(response, text->data, text->length);
+}
+
+/* Append the phase times (in microseconds) and the counters of a result */
+static Boolean put_stats(TextBuffer *response, const AsmStats *stats)
+{
+    int phase;
+
+    for (phase = 0; phase < ASM_PHASE_COUNT; phase++)
+    {
+        if (!put_u32(response, (unsigned long)(stats->wall_seconds[phase] * 1e6)) ||
+            !put_u32(response, (unsigned long)(stats->cpu_seconds[phase] * 1e6)))
+            return FALSE;
+    }
+    return put_u32(response, (unsigned long)stats->lines_read) &&
+           put_u32(response, (unsigned long)stats->macros_expanded) &&
+           put_u32(response, (unsigned long)stats->symbol_lookups) &&
+           put_u32(response, (unsigned long)stats->symbol_probes) &&
+           put_u32(response, (unsigned long)stats->fixups) &&
+           put_u32(response, (unsigned long)stats->allocations);
+}
+
+/* Encode the result and the captured output of one request */
+static Boolean build_response(TextBuffer *response, int success, int flags,
+                              const ConsoleCapture *capture, const AsmResult *result)
+{
+    char status = (char)(success ? 1 : 0);
+    AsmText no_text;
+    size_t start = 0;
+    int i;
+
+    no_text.data = NULL;
+    no_text.length = 0;
+
+    response->length = 0;
+    if (!append_to_text_buffer(response, &status, 1) ||
+        !put_u32(response, (unsigned long)result->error_count) ||
+        !put_u32(response, (unsigned long)capture->run_count))
+        return FALSE;
+
+    for (i = 0; i < capture->run_count; i++)
+    {
+        const ConsoleRun *run = &capture->runs[i];
+        char stream = (char)(run->stream == stderr ? 'e' : 'o');
+
+        if (!append_to_text_buffer(response, &stream, 1) ||
+            !put_u32(response, (unsigned long)(run->end - start)) ||
+            !append_to_text_buffer(response, capture->text.data + start, run->end - start))
+            return FALSE;
+        start = run->end;
+    }
+
+    return put_text(response, (flags & SERVE_FLAG_KEEP_AM) ? &result->am_text : &no_text) &&
+           put_text(response, &result->ob_text) &&
+           put_text(response, &result->ent_text) &&
+           put_text(response, &result->ext_text) &&
+           put_stats(response, &result->stats);
+}
+
+/* Assemble one request and encode the response; FALSE for a malformed request */
+static Boolean handle_request(AsmSession *session, const TextBuffer *payload, TextBuffer *response)
+{
+    const char *name = payload->data + SERVE_REQUEST_HEADER;
+    const char *name_end;
+    const char *src;
+    size_t len;
+    int kind, level, flags, max_errors;
+    int saved_level = log_level;
+    int success;
+    Boolean encoded;
+    ConsoleCapture capture;
+    AsmResult result;
+
+    if (payload->length <= SERVE_REQUEST_HEADER)
+        return FALSE;
+    name_end = memchr(name, '\0', payload->length - SERVE_REQUEST_HEADER);
+    if (!name_end)
+        return FALSE;
+
+    kind = payload->data[0];
+    level = payload->data[1];
+    flags = payload->data[2];
+    max_errors = (int)(get_u32(payload->data + 3) & 0x7FFFFFFFUL);
+    src = name_end + 1;
+    len = payload->data + payload->length - src;
+    if (kind != SERVE_REQUEST_SOURCE)
+        return FALSE;
+
+    init_console_capture(&capture);
+    memset(&result, 0, sizeof(result));
+
+    /* the request runs at the client's verbosity, printing into the capture */
+    log_level = (level >= LOG_QUIET && level <= LOG_DEBUG) ? level : LOG_NORMAL;
+    set_console_capture(&capture);
+
+    success = asm_session_assemble(session, name, src, len, max_errors, &result);
+
+    set_console_capture(NULL);
+    log_level = saved_level;
+
+    encoded = build_response(response, success, flags, &capture, &result);
+
+    asm_free_result(&result);
+    free_console_capture(&capture);
+    return encoded;
+}
+
+/* Answer the requests of one connection until the client hangs up */
+static void handle_connection(AsmSession *session, int fd)
+{
+    TextBuffer request;
+    TextBuffer response;
+
+    init_text_buffer(&request);
+    init_text_buffer(&response);
+
+    while (!stop_serving && receive_frame(fd, &request))
+    {
+        if (!handle_request(session, &request, &response) ||
+            !send_frame(fd, response.data, response.length))
+            break;
+    }
+
+    free_text_buffer(&request);
+    free_text_buffer(&response);
+}
+
+/* Fill a socket address; FALSE if the path does not fit */
+static Boolean make_socket_address(const char *socket_path, struct sockaddr_un *address)
+{
+    if (strlen(socket_path) >= sizeof(address->sun_path))
+        return FALSE;
+
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    strcpy(address->sun_path, socket_path);
+    return TRUE;
+}
+
+/* Connect to a daemon; -1 if none is listening on socket_path */
+int connect_to_server(const char *socket_path)
+{
+    struct sockaddr_un address;
+    int fd;
+
+    if (!make_socket_address(socket_path, &address))
+        return -1;
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address)) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * @brief Run the daemon
+ * @param socket_path Path of the Unix socket to create
+ * @return Exit status: 0 after SIGINT/SIGTERM, 1 if the socket cannot be set up
+ *
+ * A socket file left behind by a daemon that was killed is replaced;
+ * a socket with a live daemon behind it is not.
+ */
+int serve(const char *socket_path)
+{
+    struct sockaddr_un address;
+    struct sigaction action;
+    struct stat info;
+    AsmSession *session;
+    int listen_fd;
+    int fd;
+
+    if (!make_socket_address(socket_path, &address))
+    {
+        console_err("Error: Socket path too long: %s\n", socket_path);
+        return 1;
+    }
+
+    fd = connect_to_server(socket_path);
+    if (fd >= 0)
+    {
+        close(fd);
+        console_err("Error: A server is already running on %s\n", socket_path);
+        return 1;
+    }
+    if (lstat(socket_path, &info) == 0 && S_ISSOCK(info.st_mode))
+        unlink(socket_path);
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0 ||
+        bind(listen_fd, (struct sockaddr *)&address, sizeof(address)) < 0 ||
+        listen(listen_fd, SERVE_BACKLOG) < 0)
+    {
+        console_err("Error: Cannot listen on %s: %s\n", socket_path, strerror(errno));
+        if (listen_fd >= 0)
+            close(listen_fd);
+        return 1;
+    }
+
+    session = asm_session_create();
+    if (!session)
+    {
+        print_error(MEMORY_ALLOCATION_ERROR, 0, "creating the server session");
+        close(listen_fd);
+        unlink(socket_path);
+        return 1;
+    }
+
+    /* no SA_RESTART, so a signal also interrupts a waiting accept() */
+    memset(&action, 0, sizeof(action));
+    sigemptyset(&action.sa_mask);
+    action.sa_handler = request_stop;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    action.sa_handler = SIG_IGN; /* a client that hangs up must not kill the daemon */
+    sigaction(SIGPIPE, &action, NULL);
+
+    log_info(("Serving on %s\n", socket_path));
+    fflush(stdout);
+
+    while (!stop_serving)
+    {
+        fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            console_err("Error: accept failed: %s\n", strerror(errno));
+            break;
+        }
+        handle_connection(session, fd);
+        close(fd);
+    }
+
+    asm_session_free(session);
+    close(listen_fd);
+    unlink(socket_path);
+    log_info(("Server on %s stopped\n", socket_path));
+    return 0;
+}
+
+/* Copy one optional text of a response into a result */
+static Boolean take_response_text(const char **cursor, const char *end, AsmText *text)
+{
+    unsigned long length;
+
+    if (end - *cursor < 4)
+        return FALSE;
+    length = get_u32(*cursor);
+    *cursor += 4;
+    if (length == SERVE_NO_TEXT)
+        return TRUE;
+    if ((unsigned long)(end - *cursor) < length)
+        return FALSE;
+
+    text->data = malloc(length + 1);
+    if (!text->data)
+        return FALSE;
+    memcpy(text->data, *cursor, length);
+    text->data[length] = '\0';
+    text->length = length;
+    *cursor += length;
+    return TRUE;
+}
+
+/* Read the stats at the end of a response */
+static Boolean take_response_stats(const char *cursor, const char *end, AsmStats *stats)
+{
+    int phase;
+
+    if (end - cursor != (2 * ASM_PHASE_COUNT + SERVE_STATS_COUNTERS) * 4)
+        return FALSE;
+    for (phase = 0; phase < ASM_PHASE_COUNT; phase++, cursor += 8)
+    {
+        stats->wall_seconds[phase] = get_u32(cursor) / 1e6;
+        stats->cpu_seconds[phase] = get_u32(cursor + 4) / 1e6;
+    }
+    stats->lines_read = (long)get_u32(cursor);
+    stats->macros_expanded = (long)get_u32(cursor + 4);
+    stats->symbol_lookups = (long)get_u32(cursor + 8);
+    stats->symbol_probes = (long)get_u32(cursor + 12);
+    stats->fixups = (long)get_u32(cursor + 16);
+    stats->allocations = (long)get_u32(cursor + 20);
+    return TRUE;
+}
+
+/* Print the output of a response and copy its texts and stats into out */
+static Boolean decode_response(const TextBuffer *payload, AsmResult *out, int *success)
+{
+    const char *cursor = payload->data;
+    const char *end = payload->data + payload->length;
+    unsigned long run_count;
+    unsigned long i;
+
+    if (payload->length < SERVE_RESPONSE_HEADER)
+        return FALSE;
+    *success = cursor[0] == 1;
+    out->error_count = (int)(get_u32(cursor + 1) & 0x7FFFFFFFUL);
+    run_count = get_u32(cursor + 5);
+    cursor += SERVE_RESPONSE_HEADER;
+
+    for (i = 0; i < run_count; i++)
+    {
+        FILE *stream;
+        unsigned long length;
+
+        if (end - cursor < 5)
+            return FALSE;
+        stream = cursor[0] == 'e' ? stderr : stdout;
+        length = get_u32(cursor + 1);
+        cursor += 5;
+        if ((unsigned long)(end - cursor) < length)
+            return FALSE;
+        console_write_text(stream, cursor, length);
+        cursor += length;
+    }
+
+    return take_response_text(&cursor, end, &out->am_text) &&
+           take_response_text(&cursor, end, &out->ob_text) &&
+           take_response_text(&cursor, end, &out->ent_text) &&
+           take_response_text(&cursor, end, &out->ext_text) &&
+           take_response_stats(cursor, end, &out->stats);
+}
+
+/**
+ * @brief Let the daemon assemble a source, like asm_assemble_source
+ * @return TRUE if the file assembled
+ *
+ * The daemon's output is printed here, in order. Only the texts, the
+ * error count and the stats of out are filled; release it with
+ * asm_free_result.
+ */
+Boolean client_assemble(const char *socket_path, int flags, const char *name,
+                        const char *src, size_t len, int max_errors, AsmResult *out)
+{
+    TextBuffer request;
+    TextBuffer response;
+    Boolean exchanged;
+    int success = 0;
+    int fd;
+
+    memset(out, 0, sizeof(*out));
+
+    fd = connect_to_server(socket_path);
+    if (fd < 0)
+    {
+        console_out("Error: Cannot connect to assembler server at %s\n", socket_path);
+        return FALSE;
+    }
+
+    init_text_buffer(&request);
+    init_text_buffer(&response);
+    exchanged = build_request(&request, SERVE_REQUEST_SOURCE, flags, name, src, len, max_errors) &&
+                send_frame(fd, request.data, request.length) &&
+                receive_frame(fd, &response) &&
+                decode_response(&response, out, &success);
+    if (!exchanged)
+    {
+        console_out("Error: No valid response from assembler server at %s\n", socket_path);
+    }
+
+    close(fd);
+    free_text_buffer(&request);
+    free_text_buffer(&response);
+    return (exchanged && success) ? TRUE : FALSE;
+}
@@ -0,0 +1,55 @@
+/* serve.h - assembler daemon (--serve) and its client (--client)
+ *
+ * The daemon listens on a Unix domain socket and assembles requests in
+ * one warm AsmSession, so a build pays for process startup once instead
+ * of once per file.
+ *
+ * Every message is a frame: a 4-byte big-endian payload length, then
+ * the payload. A connection may carry any number of request/response
+ * pairs; the daemon serves one connection at a time.
+ *
+ * Request payload:
+ *   kind        1 byte  SERVE_REQUEST_SOURCE; the daemon never opens files itself
+ *   log level   1 byte  LOG_QUIET .. LOG_DEBUG, as set by -q/-v/-vv
+ *   flags       1 byte  SERVE_FLAG_KEEP_AM: also return the .am text
+ *   max errors  4 bytes --max-errors, 0 = no limit
+ *   name        NUL terminated file name without .as, for messages
+ *   source      the rest of the payload
+ *
+ * Response payload:
+ *   status      1 byte  1 if the file assembled, 0 otherwise
+ *   errors      4 bytes diagnostics reported
+ *   runs        4 bytes count, then per run: 'o' (stdout) or 'e' (stderr),
+ *               4-byte length and the text - everything the assembly
+ *               printed, in order
+ *   am, ob, ent, ext   4-byte length and the text each;
+ *               SERVE_NO_TEXT as the length when the file is not produced
+ *   stats       4 bytes each: wall then CPU microseconds of every phase,
+ *               then the AsmStats counters in declaration order
+ */
+#ifndef SERVE_H
+#define SERVE_H
+
+#include "assembler.h"
+#include "asm.h"
+
+#define SERVE_REQUEST_SOURCE 'S'
+#define SERVE_FLAG_KEEP_AM 1
+#define SERVE_NO_TEXT 0xFFFFFFFFUL
+#define SERVE_MAX_FRAME (64UL * 1024 * 1024) /* larger frames are refused */
+
+/* framing */
+Boolean send_frame(int fd, const char *data, size_t length);
+Boolean receive_frame(int fd, TextBuffer *payload);
+Boolean build_request(TextBuffer *request, int kind, int flags, const char *name,
+                      const char *src, size_t len, int max_errors);
+
+/* daemon: serve until SIGINT/SIGTERM; returns the exit status */
+int serve(const char *socket_path);
+
+/* client side */
+int connect_to_server(const char *socket_path);
+Boolean client_assemble(const char *socket_path, int flags, const char *name,
+                        const char *src, size_t len, int max_errors, AsmResult *out);
+
+#endif /* SERVE_H */
@@ -0,0 +1,156 @@
+/**
+ * @file stats.c
+ * @brief Per-phase timing and counters (--stats)
+ *
+ * The library times every phase of every assembly and counts what the
+ * phases did (see AsmStats in asm.h). Collecting costs two clock reads
+ * at each phase boundary and plain counter increments, so it is always
+ * on; --stats only decides whether the numbers are printed.
+ *
+ * CPU time is that of the calling thread, so it stays per file under -j.
+ */
+
+/* for clock_gettime under -ansi */
+#define _POSIX_C_SOURCE 200112L
+
+#include "stats.h"
+#include <time.h>
+
+static const char *const phase_names[ASM_PHASE_COUNT] = {
+    "preassembler", "first_pass", "memory_image", "second_pass", "output"};
+
+static double seconds(clockid_t id)
+{
+    struct timespec ts;
+
+    if (clock_gettime(id, &ts) != 0)
+        return 0;
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void start_phase_clock(PhaseClock *clock)
+{
+    clock->wall = seconds(CLOCK_MONOTONIC);
+    clock->cpu = seconds(CLOCK_THREAD_CPUTIME_ID);
+}
+
+/* Add the time since start_phase_clock to one phase */
+void stop_phase_clock(const PhaseClock *clock, AsmStats *stats, AsmPhase phase)
+{
+    stats->wall_seconds[phase] += seconds(CLOCK_MONOTONIC) - clock->wall;
+    stats->cpu_seconds[phase] += seconds(CLOCK_THREAD_CPUTIME_ID) - clock->cpu;
+}
+
+static void add_stats(FileStats *total, const FileStats *file)
+{
+    int phase;
+
+    for (phase = 0; phase < ASM_PHASE_COUNT; phase++)
+    {
+        total->assembly.wall_seconds[phase] += file->assembly.wall_seconds[phase];
+        total->assembly.cpu_seconds[phase] += file->assembly.cpu_seconds[phase];
+    }
+    total->assembly.lines_read += file->assembly.lines_read;
+    total->assembly.macros_expanded += file->assembly.macros_expanded;
+    total->assembly.symbol_lookups += file->assembly.symbol_lookups;
+    total->assembly.symbol_probes += file->assembly.symbol_probes;
+    total->assembly.fixups += file->assembly.fixups;
+    total->assembly.allocations += file->assembly.allocations;
+    total->bytes_written += file->bytes_written;
+}
+
+static double average_probes(const AsmStats *stats)
+{
+    return stats->symbol_lookups ? (double)stats->symbol_probes / stats->symbol_lookups : 0;
+}
+
+static void print_text(FILE *stream, const char *title, const FileStats *stats)
+{
+    double wall = 0, cpu = 0;
+    int phase;
+
+    fprintf(stream, "Stats: %s%s\n", title, stats->cached ? " (outputs from the cache)" : "");
+    fprintf(stream, "  %-14s %10s %10s\n", "phase", "wall ms", "cpu ms");
+    for (phase = 0; phase < ASM_PHASE_COUNT; phase++)
+    {
+        fprintf(stream, "  %-14s %10.3f %10.3f\n", phase_names[phase],
+                stats->assembly.wall_seconds[phase] * 1000, stats->assembly.cpu_seconds[phase] * 1000);
+        wall += stats->assembly.wall_seconds[phase];
+        cpu += stats->assembly.cpu_seconds[phase];
+    }
+    fprintf(stream, "  %-14s %10.3f %10.3f\n", "all phases", wall * 1000, cpu * 1000);
+    fprintf(stream, "  lines read %ld, macros expanded %ld, symbol lookups %ld (%.2f probes each)\n",
+            stats->assembly.lines_read, stats->assembly.macros_expanded,
+            stats->assembly.symbol_lookups, average_probes(&stats->assembly));
+    fprintf(stream, "  fixups %ld, arena allocations %ld, bytes written %ld\n",
+            stats->assembly.fixups, stats->assembly.allocations, stats->bytes_written);
+}
+
+/* A JSON string; file names may hold quotes, backslashes or control characters */
+static void print_json_string(FILE *stream, const char *text)
+{
+    fputc('"', stream);
+    for (; *text; text++)
+    {
+        if (*text == '"' || *text == '\\')
+            fprintf(stream, "\\%c", *text);
+        else if ((unsigned char)*text < 0x20)
+            fprintf(stream, "\\u%04x", (unsigned char)*text);
+        else
+            fputc(*text, stream);
+    }
+    fputc('"', stream);
+}
+
+/* The members shared by a file and the total; the caller opens and closes the object */
+static void print_json_members(FILE *stream, const FileStats *stats)
+{
+    int phase;
+
+    fprintf(stream, "\"phases\": {");
+    for (phase = 0; phase < ASM_PHASE_COUNT; phase++)
+    {
+        fprintf(stream, "%s\"%s\": {\"wall_ms\": %.3f, \"cpu_ms\": %.3f}", phase ? ", " : "",
+                phase_names[phase], stats->assembly.wall_seconds[phase] * 1000,
+                stats->assembly.cpu_seconds[phase] * 1000);
+    }
+    fprintf(stream, "}, \"lines_read\": %ld, \"macros_expanded\": %ld, \"symbol_lookups\": %ld, "
+            "\"average_probes\": %.3f, \"fixups\": %ld, \"allocations\": %ld, \"bytes_written\": %ld",
+            stats->assembly.lines_read, stats->assembly.macros_expanded,
+            stats->assembly.symbol_lookups, average_probes(&stats->assembly),
+            stats->assembly.fixups, stats->assembly.allocations, stats->bytes_written);
+}
+
+/* Print the report for every file and the total to stream, as text or JSON */
+void print_stats(FILE *stream, const char **files, const FileStats *stats, int file_count, int format)
+{
+    FileStats total;
+    char title[64];
+    int i;
+
+    memset(&total, 0, sizeof(total));
+    for (i = 0; i < file_count; i++)
+        add_stats(&total, &stats[i]);
+
+    if (format == STATS_JSON)
+    {
+        fprintf(stream, "{\"files\": [");
+        for (i = 0; i < file_count; i++)
+        {
+            fprintf(stream, "%s\n  {\"name\": ", i ? "," : "");
+            print_json_string(stream, files[i]);
+            fprintf(stream, ", \"cached\": %s, ", stats[i].cached ? "true" : "false");
+            print_json_members(stream, &stats[i]);
+            fprintf(stream, "}");
+        }
+        fprintf(stream, "\n],\n\"total\": {\"files\": %d, ", file_count);
+        print_json_members(stream, &total);
+        fprintf(stream, "}}\n");
+        return;
+    }
+
+    for (i = 0; i < file_count; i++)
+        print_text(stream, files[i], &stats[i]);
+    sprintf(title, "total (%d files)", file_count);
+    print_text(stream, title, &total);
+}
@@ -0,0 +1,34 @@
+/* stats.h - per-phase timing and counters (--stats) */
+#ifndef STATS_H
+#define STATS_H
+
+#include "assembler.h"
+#include "asm.h"
+
+/* report formats of --stats */
+#define STATS_OFF 0
+#define STATS_TEXT 1 /* --stats */
+#define STATS_JSON 2 /* --stats=json */
+
+/* wall and CPU time at the start of a phase */
+typedef struct
+{
+    double wall;
+    double cpu;
+} PhaseClock;
+
+void start_phase_clock(PhaseClock *clock);
+void stop_phase_clock(const PhaseClock *clock, AsmStats *stats, AsmPhase phase);
+
+/* one file of a --stats report */
+typedef struct FileStats
+{
+    AsmStats assembly;  /* from the library or the --serve daemon; output includes writing */
+    long bytes_written; /* .am/.ob/.ent/.ext bytes written */
+    Boolean cached;     /* outputs came from --cache-dir; only the writing was timed */
+} FileStats;
+
+/* Print the report for every file and the total to stream, as text or JSON */
+void print_stats(FILE *stream, const char **files, const FileStats *stats, int file_count, int format);
+
+#endif /* STATS_H */
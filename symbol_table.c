@@ -8,21 +8,145 @@
  */
 
 #include "symbol_table.h"
+#include "hash_utils.h"
+#include "console.h"
 
-/* Global symbol table head pointer */
-Symbol *symbol_table_head = NULL;
+/* smallest index size; always a power of two */
+#define SYMBOL_INDEX_MIN_CAPACITY 64
+
+/**
+ * @brief Find the index slot for a name
+ * @param table Symbol table with a non-empty index
+ * @param name Symbol name
+ * @param probes Receives the number of slots visited
+ * @return Slot holding the symbol, or the empty slot where it belongs
+ */
+static int find_symbol_slot(const SymbolTable *table, const char *name, long *probes)
+{
+    unsigned long mask = (unsigned long)table->index_capacity - 1;
+    unsigned long slot = hash_string(name, (int)strlen(name)) & mask;
+
+    *probes = 1;
+    while (table->index[slot] && strcmp(table->index[slot]->name, name) != 0)
+    {
+        slot = (slot + 1) & mask;
+        (*probes)++;
+    }
+
+    return (int)slot;
+}
+
+/**
+ * @brief Resize the index so that it can hold the given number of symbols
+ * @param table Symbol table
+ * @param min_symbols Number of symbols the index must hold below 50% load
+ * @return FALSE if out of memory; the old index is then kept
+ */
+static Boolean grow_symbol_index(SymbolTable *table, int min_symbols)
+{
+    int new_capacity = table->index_capacity ? table->index_capacity : SYMBOL_INDEX_MIN_CAPACITY;
+    Symbol **new_index;
+    Symbol *current;
+
+    while (new_capacity < min_symbols * 2)
+    {
+        new_capacity *= 2;
+    }
+    if (new_capacity == table->index_capacity)
+    {
+        return TRUE;
+    }
+
+    new_index = (Symbol **)calloc(new_capacity, sizeof(Symbol *));
+    if (!new_index) {
+        return FALSE;
+    }
+    free(table->index);
+    table->index = new_index;
+    table->index_capacity = new_capacity;
+
+    /* re-insert every symbol; names are unique so no compare is needed */
+    for (current = table->head; current; current = current->next) {
+        unsigned long mask = (unsigned long)table->index_capacity - 1;
+        unsigned long slot = hash_string(current->name, (int)strlen(current->name)) & mask;
+        while (table->index[slot])
+        {
+            slot = (slot + 1) & mask;
+        }
+        table->index[slot] = current;
+    }
+    return TRUE;
+}
+
+/* Prepare an empty symbol table whose symbols are allocated from arena */
+void init_symbol_table(SymbolTable *table, Arena *arena)
+{
+    table->arena = arena;
+    table->head = NULL;
+    table->tail = NULL;
+    table->index = NULL;
+    table->index_capacity = 0;
+    table->count = 0;
+    table->lookups = 0;
+    table->probes = 0;
+}
+
+/* Free the index and forget all symbols; the nodes belong to the arena */
+void release_symbol_table(SymbolTable *table)
+{
+    free(table->index);
+    init_symbol_table(table, table->arena);
+}
+
+/* Forget all symbols but keep the index allocation for the next file */
+void clear_symbol_table(SymbolTable *table)
+{
+    if (table->index)
+        memset(table->index, 0, table->index_capacity * sizeof(Symbol *));
+    table->head = NULL;
+    table->tail = NULL;
+    table->count = 0;
+    table->lookups = 0;
+    table->probes = 0;
+}
+
+/**
+ * @brief Size the symbol index for an expected number of symbols
+ * @param table Symbol table
+ * @param expected_count Number of symbols the caller is about to add
+ *
+ * Optional - the index also grows on its own - but avoids rehashing
+ * when the symbol count is known in advance. Without memory for it the
+ * table is left as it is.
+ */
+void reserve_symbol_table(SymbolTable *table, int expected_count)
+{
+    grow_symbol_index(table, table->count + expected_count);
+}
 
 /**
  * @brief Add a new symbol to the symbol table
+ * @param table Symbol table
  * @param name Symbol name
  * @param address Symbol address
  * @param type Symbol type (CODE, DATA, EXTERN_SYM)
+ * @return The new symbol, or NULL (reported, table unchanged) if out of memory
  */
-void add_symbol(const char *name, int address, SymbolType type) {
-    Symbol *new_symbol = (Symbol *)malloc(sizeof(Symbol));
+Symbol *add_symbol(SymbolTable *table, const char *name, int address, SymbolType type) {
+    Symbol *new_symbol;
+    long probes; /* inserts are not lookups; only find_symbol counts */
+
+    /* make room first, so a failure leaves the table as it was */
+    if ((table->count + 1) * 2 > table->index_capacity &&
+        !grow_symbol_index(table, table->count + 1)) {
+        console_err("Memory allocation failed for symbol index.\n");
+        return NULL;
+    }
+
+    new_symbol = (Symbol *)arena_alloc(table->arena, sizeof(Symbol));
     if (!new_symbol) {
-        fprintf(stderr, "Memory allocation failed for symbol.\n");
-        exit(1);
+        console_err("Memory allocation failed for symbol.\n");
+        return NULL;
     }
 
     strncpy(new_symbol->name, name, 30);
@@ -30,12 +154,24 @@ void add_symbol(const char *name, int address, SymbolType type) {
     new_symbol->address = address;
     new_symbol->type = type;
     new_symbol->is_entry = 0;
-    new_symbol->next = symbol_table_head;
-    symbol_table_head = new_symbol;
+    new_symbol->next = NULL;
+
+    /* append so that the list keeps insertion order */
+    if (table->tail) {
+        table->tail->next = new_symbol;
+    } else {
+        table->head = new_symbol;
+    }
+    table->tail = new_symbol;
+    table->count++;
+    table->index[find_symbol_slot(table, new_symbol->name, &probes)] = new_symbol;
+
+    return new_symbol;
 }
 
 /**
  * @brief Add symbol to table with comprehensive validation
+ * @param table Symbol table
  * @param label Symbol name to add
  * @param address Symbol address
  * @param type Symbol type
@@ -43,20 +179,20 @@ void add_symbol(const char *name, int address, SymbolType type) {
  * @param is_entry Whether this is an entry directive
  * @return 1 on success, 0 on error
  */
-int add_symbol_to_table(const char *label, int address, SymbolType type,
+int add_symbol_to_table(SymbolTable *table, const char *label, int address, SymbolType type,
                         int line_number, int is_entry) {
     int addr_to_set;
     Symbol *exists;  
     if (!label || strlen(label) == 0) {
-        fprintf(stderr, "Error: Empty label at line %d\n", line_number);
+        console_err("Error: Empty label at line %d\n", line_number);
         return 0;
     }
 
-    exists = find_symbol(label);
+    exists = find_symbol(table, label);
     if (exists) {
         if (is_entry) {
             if (exists->type == EXTERN_SYM) {
-                fprintf(stderr, "Error: .entry on extern label '%s' at line %d\n", label, line_number);
+                console_err("Error: .entry on extern label '%s' at line %d\n", label, line_number);
                 return 0;
             }
             exists->is_entry = 1;
@@ -74,62 +210,73 @@ int add_symbol_to_table(const char *label, int address, SymbolType type,
 
         if (type == EXTERN_SYM) {
             if (exists->type != EXTERN_SYM) {
-                fprintf(stderr, "Error: Label '%s' already defined (not extern) at line %d\n",
+                console_err("Error: Label '%s' already defined (not extern) at line %d\n",
                         label, line_number);
                 return 0;
             }
             return 1;
         }
 
-        fprintf(stderr, "Error: Duplicate label '%s' at line %d\n", label, line_number);
+        console_err("Error: Duplicate label '%s' at line %d\n", label, line_number);
         return 0;
     }
 
     addr_to_set = (type == EXTERN_SYM) ? 0 : address;
-    add_symbol(label, addr_to_set, type);
+    exists = add_symbol(table, label, addr_to_set, type);
+    if (!exists) {
+        return 0;
+    }
 
     if (is_entry) {
         if (type == EXTERN_SYM) {
-            fprintf(stderr, "Error: .entry cannot be applied to extern label '%s' (line %d)\n",
+            console_err("Error: .entry cannot be applied to extern label '%s' (line %d)\n",
                     label, line_number);
             return 0;
         }
-        symbol_table_head->is_entry = 1;
+        exists->is_entry = 1;
     }
 
     return 1;
 }
 
-Symbol *find_symbol(const char *name) {
-    Symbol *current = symbol_table_head;
-    while (current) {
-        if (strcmp(current->name, name) == 0)
-            return current;
-        current = current->next;
-    }
-    return NULL;
+Symbol *find_symbol(SymbolTable *table, const char *name) {
+    Symbol *symbol;
+    long probes;
+
+    if (!name || table->count == 0)
+        return NULL;
+    symbol = table->index[find_symbol_slot(table, name, &probes)];
+    table->lookups++;
+    table->probes += probes;
+    return symbol;
+}
+
+Boolean is_symbol_defined(SymbolTable *table, const char *name) {
+    return find_symbol(table, name) ? TRUE : FALSE;
+}
+
+Boolean mark_symbol_as_entry(SymbolTable *table, const char *name) {
+    Symbol *symbol = find_symbol(table, name);
+    if (!symbol || symbol->type == EXTERN_SYM)
+        return FALSE;
+    symbol->is_entry = 1;
+    return TRUE;
 }
 
-void print_symbol_table() {
-    Symbol *current = symbol_table_head;
-    printf("Symbol Table:\n");
+int get_symbol_count(const SymbolTable *table) {
+    return table->count;
+}
+
+void print_symbol_table(const SymbolTable *table) {
+    Symbol *current = table->head;
+    log_verbose(("Symbol Table:\n"));
     while (current) {
         const char *t =
             (current->type == CODE) ? "CODE" :
             (current->type == DATA) ? "DATA" : "EXTERN";
-        printf("Name: %s, Address: %d, Type: %s, Entry: %s\n",
+        log_verbose(("Name: %s, Address: %d, Type: %s, Entry: %s\n",
                current->name, current->address, t,
-               current->is_entry ? "YES" : "NO");
+               current->is_entry ? "YES" : "NO"));
         current = current->next;
     }
 }
-
-void free_symbol_table() {
-    Symbol *current = symbol_table_head;
-    while (current) {
-        Symbol *next = current->next;
-        free(current);
-        current = next;
-    }
-    symbol_table_head = NULL;
-}
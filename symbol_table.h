@@ -3,20 +3,35 @@
 #define SYMBOL_TABLE_H
 
 #include "types.h" /* includes the definitions of Symbol and SymbolType */
+#include "arena.h"
 
-/* single global variable - head of the symbol list */
-extern Symbol *symbol_table_head;
+/* symbols of one file: list in insertion order plus an open-addressing
+   index over it (linear probing) */
+typedef struct
+{
+    Arena *arena; /* where the symbols are allocated */
+    Symbol *head;
+    Symbol *tail;
+    Symbol **index;
+    int index_capacity; /* power of two, kept above twice the count */
+    int count;
+    long lookups; /* searches of the index (AsmStats) */
+    long probes;  /* index slots those searches visited */
+} SymbolTable;
 
 /* symbol table functions */
-void add_symbol(const char *name, int address, SymbolType type);
-Symbol *find_symbol(const char *name);
-void print_symbol_table(void);
-void free_symbol_table(void);
-int add_symbol_to_table(const char *label, int address, SymbolType type, int line_number, int is_entry);
+void init_symbol_table(SymbolTable *table, Arena *arena);
+void release_symbol_table(SymbolTable *table);
+void clear_symbol_table(SymbolTable *table);
+Symbol *add_symbol(SymbolTable *table, const char *name, int address, SymbolType type);
+Symbol *find_symbol(SymbolTable *table, const char *name);
+void print_symbol_table(const SymbolTable *table);
+int add_symbol_to_table(SymbolTable *table, const char *label, int address, SymbolType type, int line_number, int is_entry);
+void reserve_symbol_table(SymbolTable *table, int expected_count);
 
 /* helper functions */
-Boolean is_symbol_defined(const char *name);
-Boolean mark_symbol_as_entry(const char *name);
-int get_symbol_count(void);
+Boolean is_symbol_defined(SymbolTable *table, const char *name);
+Boolean mark_symbol_as_entry(SymbolTable *table, const char *name);
+int get_symbol_count(const SymbolTable *table);
 
 #endif /* SYMBOL_TABLE_H */
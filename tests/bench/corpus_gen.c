@@ -0,0 +1,403 @@
+/**
+ * @file corpus_gen.c
+ * @brief Generates a corpus of valid assembly programs for make bench
+ *
+ * Writes DIR/prog_NNNN.as files that together hold about --lines source
+ * lines, plus DIR/manifest with the file and line counts. Every program
+ * fits the 256-word memory image, so a large corpus is many files.
+ * The mix is configurable:
+ *   --lines N       total source lines (default 40000)
+ *   --file-lines N  most statements per file (default 60)
+ *   --labels P      percent of statements with a label (default 30)
+ *   --macros N      macros defined per file (default 3)
+ *   --calls P       percent of statements that are macro calls (default 10)
+ *   --externs N     .extern symbols per file (default 2)
+ *   --entries N     .entry symbols per file (default 2)
+ *   --data P        .data/.string/.mat statements per 100 instructions (default 20)
+ *   --matrix P      percent of symbol operands that are matrix accesses (default 15)
+ *   --seed N        random seed (default 1)
+ * Macro bodies are emitted verbatim by the pre-assembler, so "nested use"
+ * is a macro called under a label and called many times, not a macro
+ * call inside another macro.
+ * Usage: corpus_gen DIR [options]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WORD_LIMIT 150 /* instruction + data words per program; addresses stay below 256 */
+#define MAX_NAMES 256
+
+typedef struct
+{
+    long lines;
+    int file_lines;
+    int label_percent;
+    int macros;
+    int call_percent;
+    int externs;
+    int entries;
+    int data_percent;
+    int matrix_percent;
+    unsigned long seed;
+} CorpusOptions;
+
+/* operand kinds, as addressing method bits */
+#define IMMEDIATE 1
+#define DIRECT 2
+#define MATRIX 4
+#define REGISTER 8
+#define ANY (IMMEDIATE | DIRECT | MATRIX | REGISTER)
+#define NOT_IMMEDIATE (DIRECT | MATRIX | REGISTER)
+#define SYMBOL (DIRECT | MATRIX)
+
+typedef struct
+{
+    const char *name;
+    int operands;
+    int source_modes;
+    int target_modes;
+} Opcode;
+
+/* same rules as instruction_table.c; stop ends every program */
+static const Opcode opcodes[] = {
+    {"mov", 2, ANY, NOT_IMMEDIATE},
+    {"cmp", 2, ANY, ANY},
+    {"add", 2, ANY, NOT_IMMEDIATE},
+    {"sub", 2, ANY, NOT_IMMEDIATE},
+    {"lea", 2, SYMBOL, DIRECT | REGISTER},
+    {"clr", 1, 0, NOT_IMMEDIATE},
+    {"not", 1, 0, NOT_IMMEDIATE},
+    {"inc", 1, 0, NOT_IMMEDIATE},
+    {"dec", 1, 0, NOT_IMMEDIATE},
+    {"jmp", 1, 0, SYMBOL},
+    {"bne", 1, 0, SYMBOL},
+    {"jsr", 1, 0, SYMBOL},
+    {"red", 1, 0, NOT_IMMEDIATE},
+    {"prn", 1, 0, ANY},
+    {"rts", 0, 0, 0}};
+
+#define OPCODE_COUNT (sizeof(opcodes) / sizeof(opcodes[0]))
+
+/* symbols a program may reference */
+typedef struct
+{
+    char code[MAX_NAMES][16]; /* code labels, defined as the program goes */
+    int code_count;
+    char data[MAX_NAMES][16]; /* data labels, defined after the code */
+    int data_count;
+    char matrix[MAX_NAMES][16]; /* .mat labels, defined after the code */
+    int matrix_count;
+    char external[MAX_NAMES][16];
+    int external_count;
+} Names;
+
+static unsigned long random_state;
+
+/* deterministic, so the same options always give the same corpus */
+static int random_below(int limit)
+{
+    random_state = (random_state * 1103515245UL + 12345UL) & 0x7FFFFFFFUL;
+    return (int)((random_state >> 8) % (unsigned long)limit);
+}
+
+static int chance(int percent)
+{
+    return random_below(100) < percent;
+}
+
+/* pick one allowed addressing mode */
+static int pick_mode(int modes, const CorpusOptions *options, const Names *names)
+{
+    int choices[4];
+    int count = 0;
+
+    if ((modes & MATRIX) && names->matrix_count > 0 && chance(options->matrix_percent))
+        return MATRIX;
+    if (modes & IMMEDIATE)
+        choices[count++] = IMMEDIATE;
+    if (modes & DIRECT)
+        choices[count++] = DIRECT;
+    if (modes & REGISTER)
+        choices[count++] = REGISTER;
+    return choices[random_below(count)];
+}
+
+/* write one operand; returns its kind */
+static int put_operand(char *text, int mode, const Names *names)
+{
+    int pick;
+
+    switch (mode)
+    {
+    case IMMEDIATE:
+        sprintf(text, "#%d", random_below(200) - 100);
+        break;
+    case REGISTER:
+        sprintf(text, "r%d", random_below(8));
+        break;
+    case MATRIX:
+        sprintf(text, "%s[r%d][r%d]", names->matrix[random_below(names->matrix_count)],
+                random_below(8), random_below(8));
+        break;
+    default:
+        pick = random_below(names->code_count + names->data_count + names->external_count);
+        if (pick < names->code_count)
+            strcpy(text, names->code[pick]);
+        else if (pick < names->code_count + names->data_count)
+            strcpy(text, names->data[pick - names->code_count]);
+        else
+            strcpy(text, names->external[pick - names->code_count - names->data_count]);
+        break;
+    }
+    return mode;
+}
+
+/* words taken by an instruction with the given operand kinds */
+static int instruction_words(int operands, int source, int target)
+{
+    int words = 1;
+
+    if (operands == 2 && source == REGISTER && target == REGISTER)
+        return 2;
+    if (operands == 2)
+        words += source == MATRIX ? 2 : 1;
+    if (operands >= 1)
+        words += target == MATRIX ? 2 : 1;
+    return words;
+}
+
+/* write one program; returns its source line count, or -1 */
+static long write_program(const char *filename, int statements, const CorpusOptions *options)
+{
+    static Names names;
+    static int macro_words[MAX_NAMES];
+    FILE *file = fopen(filename, "w");
+    int data_statements = statements * options->data_percent / 100;
+    int words = 0;
+    int data_words = 0;
+    long lines = 0;
+    int i, j;
+
+    if (!file)
+        return -1;
+
+    memset(&names, 0, sizeof(names));
+    strcpy(names.code[names.code_count++], "END"); /* defined by the final stop */
+
+    for (i = 0; i < options->externs && i < MAX_NAMES; i++)
+    {
+        sprintf(names.external[names.external_count++], "EXT%d", i);
+        fprintf(file, ".extern EXT%d\n", i);
+        lines++;
+    }
+
+    /* macros: two or three register-only statements */
+    for (i = 0; i < options->macros && i < MAX_NAMES; i++)
+    {
+        int body = 2 + random_below(2);
+
+        fprintf(file, "mcro mac%d\n", i);
+        macro_words[i] = 0;
+        for (j = 0; j < body; j++)
+        {
+            if (random_below(2))
+            {
+                fprintf(file, "    mov r%d, r%d\n", random_below(8), random_below(8));
+                macro_words[i] += 2;
+            }
+            else
+            {
+                fprintf(file, "    inc r%d\n", random_below(8));
+                macro_words[i] += 2;
+            }
+        }
+        fprintf(file, "mcroend\n");
+        lines += body + 2;
+    }
+
+    /* data labels are known up front so that code can reference them */
+    for (i = 0; i < data_statements && i < MAX_NAMES; i++)
+    {
+        if (i % 3 == 2)
+            sprintf(names.matrix[names.matrix_count++], "M%d", i);
+        else
+            sprintf(names.data[names.data_count++], "D%d", i);
+    }
+    /* first_pass counts .string "abc" as 6 words, the others take 4 */
+    data_words = (names.data_count / 2) * 6 + (names.data_count - names.data_count / 2) * 4 +
+                 names.matrix_count * 4;
+
+    for (i = 0; i < statements; i++)
+    {
+        char label[24] = "";
+        char source[48], target[48];
+        const Opcode *opcode;
+        int source_mode = 0, target_mode = 0;
+        int cost;
+
+        if (chance(options->label_percent) && names.code_count < MAX_NAMES)
+        {
+            sprintf(names.code[names.code_count], "L%d", names.code_count);
+            sprintf(label, "%s: ", names.code[names.code_count]);
+            names.code_count++;
+        }
+
+        if (options->macros > 0 && chance(options->call_percent))
+        {
+            int macro = random_below(options->macros < MAX_NAMES ? options->macros : MAX_NAMES);
+            if (words + data_words + macro_words[macro] + 1 > WORD_LIMIT)
+                break;
+            fprintf(file, "%s    mac%d\n", label, macro);
+            words += macro_words[macro];
+            lines++;
+            continue;
+        }
+
+        opcode = &opcodes[random_below(OPCODE_COUNT)];
+        if (opcode->operands == 2)
+            source_mode = put_operand(source, pick_mode(opcode->source_modes, options, &names), &names);
+        if (opcode->operands >= 1)
+            target_mode = put_operand(target, pick_mode(opcode->target_modes, options, &names), &names);
+
+        cost = instruction_words(opcode->operands, source_mode, target_mode);
+        if (words + data_words + cost + 1 > WORD_LIMIT)
+            break;
+        words += cost;
+
+        if (opcode->operands == 2)
+            fprintf(file, "%s    %s %s, %s\n", label, opcode->name, source, target);
+        else if (opcode->operands == 1)
+            fprintf(file, "%s    %s %s\n", label, opcode->name, target);
+        else
+            fprintf(file, "%s    %s\n", label, opcode->name);
+        lines++;
+    }
+
+    fprintf(file, "END:    stop\n");
+    lines++;
+
+    for (i = 0; i < options->entries && i < names.code_count; i++)
+    {
+        fprintf(file, ".entry %s\n", names.code[i]);
+        lines++;
+    }
+
+    /* sizes as estimated above */
+    for (i = 0, j = 0; i < names.data_count || j < names.matrix_count;)
+    {
+        if (i < names.data_count)
+        {
+            if (i % 2)
+                fprintf(file, "%s: .string \"abc\"\n", names.data[i]);
+            else
+                fprintf(file, "%s: .data %d, %d, -%d, 7\n", names.data[i],
+                        random_below(500), random_below(500), random_below(500));
+            i++;
+            lines++;
+        }
+        if (j < names.matrix_count)
+        {
+            fprintf(file, "%s: .mat [2][2] 1, 2, 3, %d\n", names.matrix[j], random_below(100));
+            j++;
+            lines++;
+        }
+    }
+
+    fclose(file);
+    return lines;
+}
+
+static int parse_options(int argc, char *argv[], CorpusOptions *options)
+{
+    int i;
+
+    options->lines = 40000;
+    options->file_lines = 60;
+    options->label_percent = 30;
+    options->macros = 3;
+    options->call_percent = 10;
+    options->externs = 2;
+    options->entries = 2;
+    options->data_percent = 20;
+    options->matrix_percent = 15;
+    options->seed = 1;
+
+    for (i = 2; i + 1 < argc; i += 2)
+    {
+        long value = atol(argv[i + 1]);
+
+        if (value < 0)
+            return 0;
+        if (strcmp(argv[i], "--lines") == 0)
+            options->lines = value;
+        else if (strcmp(argv[i], "--file-lines") == 0)
+            options->file_lines = (int)value;
+        else if (strcmp(argv[i], "--labels") == 0)
+            options->label_percent = (int)value;
+        else if (strcmp(argv[i], "--macros") == 0)
+            options->macros = (int)value;
+        else if (strcmp(argv[i], "--calls") == 0)
+            options->call_percent = (int)value;
+        else if (strcmp(argv[i], "--externs") == 0)
+            options->externs = (int)value;
+        else if (strcmp(argv[i], "--entries") == 0)
+            options->entries = (int)value;
+        else if (strcmp(argv[i], "--data") == 0)
+            options->data_percent = (int)value;
+        else if (strcmp(argv[i], "--matrix") == 0)
+            options->matrix_percent = (int)value;
+        else if (strcmp(argv[i], "--seed") == 0)
+            options->seed = (unsigned long)value;
+        else
+            return 0;
+    }
+
+    return i == argc && options->file_lines > 0;
+}
+
+int main(int argc, char *argv[])
+{
+    CorpusOptions options;
+    char filename[512];
+    long lines = 0;
+    int files = 0;
+    FILE *manifest;
+
+    if (argc < 2 || strlen(argv[1]) > 400 || !parse_options(argc, argv, &options))
+    {
+        printf("Usage: %s DIR [--lines N] [--file-lines N] [--labels P] [--macros N] [--calls P]\n"
+               "       [--externs N] [--entries N] [--data P] [--matrix P] [--seed N]\n", argv[0]);
+        return 1;
+    }
+
+    random_state = options.seed;
+    while (lines < options.lines)
+    {
+        long written;
+
+        sprintf(filename, "%s/prog_%04d.as", argv[1], files);
+        written = write_program(filename, options.file_lines, &options);
+        if (written < 0)
+        {
+            printf("Cannot write %s (does the directory exist?)\n", filename);
+            return 1;
+        }
+        lines += written;
+        files++;
+    }
+
+    sprintf(filename, "%s/manifest", argv[1]);
+    manifest = fopen(filename, "w");
+    if (!manifest)
+    {
+        printf("Cannot write %s\n", filename);
+        return 1;
+    }
+    fprintf(manifest, "files %d\nlines %ld\n", files, lines);
+    fclose(manifest);
+
+    printf("corpus: %d files, %ld lines in %s\n", files, lines, argv[1]);
+    return 0;
+}
@@ -0,0 +1,109 @@
+/**
+ * @file expansion_bench.c
+ * @brief Macro expansion throughput of the preassembler, in MB/s
+ *
+ * Builds a macro-heavy source in memory - a handful of macros, then
+ * mostly calls, some of them labeled, between ordinary lines - and runs
+ * preassembler() over it repeatedly. Reports the bytes of expanded
+ * output produced per second, and the input rate for reference.
+ * Build and run with: make bench-expansion
+ */
+
+#include "../../preassembler.h"
+#include "../../text_buffer.h"
+#include "../../context.h"
+#include <time.h>
+
+#define MACROS 16
+#define MACRO_LINES 24
+#define CALLS 40000
+#define RUNS 20
+
+/* one of the macro bodies; instructions of every operand shape */
+static void append_macro(TextBuffer *source, int index)
+{
+    char line[MAX_LINE_LENGTH];
+    int j;
+
+    sprintf(line, "mcro EXPAND%d\n", index);
+    append_to_text_buffer(source, line, strlen(line));
+    for (j = 0; j < MACRO_LINES; j++)
+    {
+        switch (j % 4)
+        {
+        case 0:
+            sprintf(line, "    mov #%d, r%d\n", index * MACRO_LINES + j, j % 8);
+            break;
+        case 1:
+            sprintf(line, "    add r%d, r%d\n", j % 8, (j + 3) % 8);
+            break;
+        case 2:
+            sprintf(line, "    lea VALUES, r%d\n", j % 8);
+            break;
+        default:
+            sprintf(line, "    prn VALUES[r%d][r%d]\n", j % 8, (j + 1) % 8);
+            break;
+        }
+        append_to_text_buffer(source, line, strlen(line));
+    }
+    append_to_text_buffer(source, "mcroend\n", 8);
+}
+
+static void build_source(TextBuffer *source)
+{
+    char line[MAX_LINE_LENGTH];
+    int i;
+
+    for (i = 0; i < MACROS; i++)
+        append_macro(source, i);
+
+    for (i = 0; i < CALLS; i++)
+    {
+        if (i % 8 == 0)
+            sprintf(line, "L%d: EXPAND%d\n", i, i % MACROS);
+        else if (i % 8 == 1)
+            sprintf(line, "    cmp #%d, r%d\n", i, i % 8);
+        else
+            sprintf(line, "    EXPAND%d\n", i % MACROS);
+        append_to_text_buffer(source, line, strlen(line));
+    }
+    append_to_text_buffer(source, "VALUES: .mat [2][2] 1, 2, 3, 4\n", 31);
+}
+
+int main(void)
+{
+    TextBuffer source;
+    TextBuffer output;
+    AssemblerContext context;
+    size_t expanded = 0;
+    clock_t start;
+    double seconds;
+    int run;
+
+    init_text_buffer(&source);
+    build_source(&source);
+    init_assembler_context(&context);
+
+    start = clock();
+    for (run = 0; run < RUNS; run++)
+    {
+        init_text_buffer(&output);
+        if (!preassembler(&context, &source, &output))
+            printf("preassembler reported errors\n");
+        expanded = output.length;
+        free_text_buffer(&output);
+        reset_assembler_context(&context);
+    }
+    seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+    if (seconds <= 0)
+        seconds = 1e-9;
+
+    printf("macro expansion: %d calls of %d-line macros, %.2f MB in, %.2f MB out per run\n",
+           CALLS - CALLS / 8, MACRO_LINES, source.length / 1e6, expanded / 1e6);
+    printf("%d runs in %.3f s: %.1f MB/s expanded output (%.1f MB/s input)\n",
+           RUNS, seconds, expanded * (double)RUNS / 1e6 / seconds, source.length * (double)RUNS / 1e6 / seconds);
+
+    free_text_buffer(&source);
+    free_assembler_context(&context);
+    return 0;
+}
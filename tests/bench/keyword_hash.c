@@ -0,0 +1,110 @@
+/**
+ * @file keyword_hash.c
+ * @brief Checks, and regenerates, the keyword perfect hash of instruction_table.c
+ *
+ * Includes instruction_table.c to see its static tables. Every keyword
+ * has to hash (KEYWORD_HASH) to a slot of keyword_slots holding its own
+ * index, and no other slot may be taken. When that fails - the keyword
+ * list changed - it searches coefficients for
+ *   (w[0] + a * w[1] + b * w[len - 1] + c * len) mod KEYWORD_SLOTS
+ * that keep the keywords apart and prints the KEYWORD_HASH definition
+ * and the table to paste into instruction_table.c, then exits with 1.
+ * Build and run with: make check-keywords
+ */
+
+#include "../../instruction_table.c"
+
+#define KEYWORD_COUNT ((int)(sizeof(keywords) / sizeof(keywords[0])))
+#define MAX_COEFFICIENT 32
+
+/* TRUE if keyword_slots matches the keyword list under KEYWORD_HASH */
+static Boolean check_table(void)
+{
+    int used = 0;
+    int i;
+
+    for (i = 0; i < KEYWORD_COUNT; i++)
+    {
+        const unsigned char *w = (const unsigned char *)keywords[i].name;
+        int slot = KEYWORD_HASH(w, keywords[i].length);
+
+        if (keyword_slots[slot] != i)
+        {
+            printf("keyword %s hashes to slot %d, which holds %d\n", keywords[i].name, slot, keyword_slots[slot]);
+            return FALSE;
+        }
+        if ((int)strlen(keywords[i].name) != keywords[i].length)
+        {
+            printf("keyword %s has length %d\n", keywords[i].name, keywords[i].length);
+            return FALSE;
+        }
+    }
+
+    for (i = 0; i < KEYWORD_SLOTS; i++)
+    {
+        if (keyword_slots[i] >= 0)
+            used++;
+    }
+    if (used != KEYWORD_COUNT)
+    {
+        printf("keyword_slots holds %d entries for %d keywords\n", used, KEYWORD_COUNT);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/* fill slots for the coefficients; FALSE on a collision */
+static Boolean try_coefficients(int a, int b, int c, signed char *slots)
+{
+    int i;
+
+    memset(slots, -1, KEYWORD_SLOTS);
+    for (i = 0; i < KEYWORD_COUNT; i++)
+    {
+        const unsigned char *w = (const unsigned char *)keywords[i].name;
+        int length = keywords[i].length;
+        int slot = (w[0] + a * w[1] + b * w[length - 1] + c * length) % KEYWORD_SLOTS;
+
+        if (slots[slot] >= 0)
+            return FALSE;
+        slots[slot] = (signed char)i;
+    }
+    return TRUE;
+}
+
+static void print_table(int a, int b, int c, const signed char *slots)
+{
+    int i;
+
+    printf("#define KEYWORD_HASH(w, length) \\\n");
+    printf("    (((w)[0] + %d * (w)[1] + %d * (w)[(length) - 1] + %d * (length)) %% KEYWORD_SLOTS)\n\n", a, b, c);
+    printf("static const signed char keyword_slots[KEYWORD_SLOTS] = {");
+    for (i = 0; i < KEYWORD_SLOTS; i++)
+        printf("%s%d%s", i % 16 == 0 ? "\n    " : " ", slots[i], i + 1 < KEYWORD_SLOTS ? "," : "};\n");
+}
+
+int main(void)
+{
+    signed char slots[KEYWORD_SLOTS];
+    int a, b, c;
+
+    if (check_table())
+    {
+        printf("keyword hash: %d keywords in %d slots, no collisions\n", KEYWORD_COUNT, KEYWORD_SLOTS);
+        return 0;
+    }
+
+    printf("keyword_slots is out of date; new definitions for instruction_table.c:\n\n");
+    for (a = 1; a < MAX_COEFFICIENT; a++)
+        for (b = 1; b < MAX_COEFFICIENT; b++)
+            for (c = 0; c < MAX_COEFFICIENT; c++)
+                if (try_coefficients(a, b, c, slots))
+                {
+                    print_table(a, b, c, slots);
+                    return 1;
+                }
+
+    printf("no collision-free coefficients below %d; raise KEYWORD_SLOTS\n", MAX_COEFFICIENT);
+    return 1;
+}
@@ -0,0 +1,175 @@
+/**
+ * @file macro_memory.c
+ * @brief Peak heap bytes of the preassembler on large macros
+ *
+ * Generates a source file that only defines large macros, runs
+ * preassembler() over it and reports the highest number of heap bytes
+ * it held at once next to the size of the macro body text. The
+ * allocator is wrapped at link time (-Wl,--wrap) and every block
+ * carries its size, so the count is exact. Macro bodies are stored
+ * once, so the peak has to stay within MAX_BYTES_PER_TEXT_BYTE of the
+ * body text; the program exits with 1 when it does not.
+ * Build and run with: make bench-macro-memory
+ */
+
+#include "../../preassembler.h"
+#include "../../text_buffer.h"
+#include "../../context.h"
+
+#define INPUT_NAME "tests/bench/macro_memory_input"
+#define MACROS 64
+#define MACRO_LINES 400
+
+/* heap held at the peak per byte of body text; the text is kept in a
+   growable buffer, which holds up to twice what it stores */
+#define MAX_BYTES_PER_TEXT_BYTE 2.5
+
+/* keeps the blocks aligned for any type */
+typedef union
+{
+    size_t size;
+    long double align;
+} BlockHeader;
+
+static long live_bytes = 0;
+static long peak_bytes = 0;
+
+void *__real_malloc(size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+static void *track(BlockHeader *header, size_t size)
+{
+    if (!header)
+        return NULL;
+    header->size = size;
+    live_bytes += (long)size;
+    if (live_bytes > peak_bytes)
+        peak_bytes = live_bytes;
+    return header + 1;
+}
+
+void *__wrap_malloc(size_t size)
+{
+    return track(__real_malloc(sizeof(BlockHeader) + size), size);
+}
+
+void *__wrap_calloc(size_t count, size_t size)
+{
+    void *block = __wrap_malloc(count * size);
+
+    if (block)
+        memset(block, 0, count * size);
+    return block;
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    BlockHeader *header;
+    size_t old_size;
+
+    if (!ptr)
+        return __wrap_malloc(size);
+
+    header = (BlockHeader *)ptr - 1;
+    old_size = header->size;
+    header = __real_realloc(header, sizeof(BlockHeader) + size);
+    if (!header)
+        return NULL;
+    live_bytes -= (long)old_size;
+    return track(header, size);
+}
+
+void __wrap_free(void *ptr)
+{
+    BlockHeader *header;
+
+    if (!ptr)
+        return;
+    header = (BlockHeader *)ptr - 1;
+    live_bytes -= (long)header->size;
+    __real_free(header);
+}
+
+/* MACROS macros of MACRO_LINES instructions each; returns the bytes of
+   body text, newlines included */
+static long write_input(const char *filename)
+{
+    FILE *file = fopen(filename, "w");
+    long text_bytes = 0;
+    int i, j;
+
+    if (!file)
+        return -1;
+
+    for (i = 0; i < MACROS; i++)
+    {
+        fprintf(file, "mcro BODY%d\n", i);
+        for (j = 0; j < MACRO_LINES; j++)
+        {
+            switch (j % 4)
+            {
+            case 0:
+                text_bytes += fprintf(file, "    mov #%d, r%d\n", i * MACRO_LINES + j, j % 8);
+                break;
+            case 1:
+                text_bytes += fprintf(file, "    add r%d, r%d\n", j % 8, (j + 1) % 8);
+                break;
+            case 2:
+                text_bytes += fprintf(file, "    cmp #%d, r%d\n", j, j % 8);
+                break;
+            default:
+                text_bytes += fprintf(file, "    prn r%d\n", j % 8);
+                break;
+            }
+        }
+        fprintf(file, "mcroend\n");
+    }
+
+    fclose(file);
+    return text_bytes;
+}
+
+int main(void)
+{
+    TextBuffer source;
+    TextBuffer output;
+    AssemblerContext context;
+    char filename[64];
+    long text_bytes, before, peak;
+    double per_byte;
+
+    sprintf(filename, "%s%s", INPUT_NAME, AS_EXTENSION);
+    text_bytes = write_input(filename);
+    if (text_bytes < 0)
+    {
+        printf("Cannot write %s\n", filename);
+        return 1;
+    }
+
+    init_text_buffer(&source);
+    if (!read_file_into_text_buffer(filename, &source))
+    {
+        printf("Cannot read %s\n", filename);
+        return 1;
+    }
+
+    init_assembler_context(&context);
+    init_text_buffer(&output);
+    before = live_bytes;
+    peak_bytes = live_bytes;
+    if (!preassembler(&context, &source, &output))
+        printf("preassembler reported errors\n");
+    peak = peak_bytes - before;
+    per_byte = (double)peak / text_bytes;
+
+    printf("macro bodies: %d macros of %d lines, %ld bytes of text\n", MACROS, MACRO_LINES, text_bytes);
+    printf("preassembler peak heap: %ld bytes, %.2f per byte of body text (limit %.2f)\n",
+           peak, per_byte, MAX_BYTES_PER_TEXT_BYTE);
+
+    free_text_buffer(&output);
+    free_text_buffer(&source);
+    free_assembler_context(&context);
+    remove(filename);
+    return per_byte > MAX_BYTES_PER_TEXT_BYTE ? 1 : 0;
+}
@@ -0,0 +1,112 @@
+/**
+ * @file preassembler_allocs.c
+ * @brief Counts heap allocations made by the preassembler per source line
+ *
+ * Generates a source file with labels, directives, instructions and macro
+ * calls, reads it into memory, runs preassembler() over it and reports how many malloc, calloc
+ * and realloc calls it made. The allocator is wrapped at link time
+ * (-Wl,--wrap), so the preassembler itself is built unchanged.
+ * Build and run with: make bench-allocs
+ */
+
+#include "../../preassembler.h"
+#include "../../text_buffer.h"
+#include "../../context.h"
+
+#define INPUT_NAME "tests/bench/preassembler_allocs_input"
+#define BLOCKS 2000
+
+static long allocation_count = 0;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+    allocation_count++;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size)
+{
+    allocation_count++;
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    allocation_count++;
+    return __real_realloc(ptr, size);
+}
+
+/* a few macros, then BLOCKS repetitions of ordinary statements and calls */
+static int write_input(const char *filename)
+{
+    FILE *file = fopen(filename, "w");
+    int i, lines = 0;
+
+    if (!file)
+        return -1;
+
+    fprintf(file, "mcro PUSH_TWO\n    mov r1, r2\n    add #1, r2\nmcroend\n");
+    fprintf(file, "mcro CLEAR\n    clr r3\nmcroend\n");
+    lines += 7;
+
+    for (i = 0; i < BLOCKS; i++)
+    {
+        fprintf(file, "; block %d\n", i);
+        fprintf(file, "L%d: mov #%d, r1\n", i, i);
+        fprintf(file, "    cmp r1, L%d\n", i);
+        fprintf(file, "    bne L%d\n", i);
+        fprintf(file, "D%d: .data 1, -2, %d\n", i, i);
+        fprintf(file, "    PUSH_TWO\n");
+        fprintf(file, "C%d: CLEAR\n", i);
+        fprintf(file, "\n");
+        lines += 8;
+    }
+
+    fclose(file);
+    return lines;
+}
+
+int main(void)
+{
+    TextBuffer source;
+    TextBuffer output;
+    AssemblerContext context;
+    char filename[64];
+    long before, allocations;
+    int lines;
+
+    sprintf(filename, "%s%s", INPUT_NAME, AS_EXTENSION);
+    lines = write_input(filename);
+    if (lines < 0)
+    {
+        printf("Cannot write %s\n", filename);
+        return 1;
+    }
+
+    init_text_buffer(&source);
+    if (!read_file_into_text_buffer(filename, &source))
+    {
+        printf("Cannot read %s\n", filename);
+        return 1;
+    }
+
+    init_assembler_context(&context);
+    init_text_buffer(&output);
+    before = allocation_count;
+    if (!preassembler(&context, &source, &output))
+        printf("preassembler reported errors\n");
+    allocations = allocation_count - before;
+
+    printf("preassembler: %d lines, %ld allocations, %.3f allocations per line\n",
+           lines, allocations, (double)allocations / lines);
+
+    free_text_buffer(&output);
+    free_text_buffer(&source);
+    free_assembler_context(&context);
+    remove(filename);
+    return 0;
+}
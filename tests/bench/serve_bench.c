@@ -0,0 +1,232 @@
+/**
+ * @file serve_bench.c
+ * @brief Requests per second - assembler daemon vs. one process per file
+ *
+ * Assembles the same small source REQUESTS times in three ways:
+ *   fork/exec     ./assembler -q file           (what a Makefile does today)
+ *   --client      ./assembler -q --client SOCK file
+ *   socket        one request frame per file over a single connection,
+ *                 i.e. the daemon's own throughput without process startup
+ * The daemon is started and stopped by the benchmark.
+ * Build and run with: make bench-serve
+ */
+
+/* for fork, waitpid and gettimeofday under -ansi */
+#define _POSIX_C_SOURCE 200112L
+
+#include "../../serve.h"
+#include "../../text_buffer.h"
+#include "../../console.h"
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define ASSEMBLER "./assembler"
+#define INPUT_NAME "tests/bench/serve_bench_input"
+#define SOCKET_PATH "tests/bench/serve_bench.sock"
+#define REQUESTS 500
+
+static double now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* a typical small program: macros, data, entries and externals */
+static int write_input(const char *filename)
+{
+    FILE *file = fopen(filename, "w");
+    int i;
+
+    if (!file)
+        return -1;
+
+    fprintf(file, ".entry MAIN\n.extern EXTERNAL\n");
+    fprintf(file, "mcro SWAP\n    mov r1, r3\n    mov r2, r1\n    mov r3, r2\nmcroend\n");
+    fprintf(file, "MAIN: mov #5, r1\n    mov #7, r2\n    SWAP\n");
+    for (i = 0; i < 10; i++)
+    {
+        fprintf(file, "L%d: cmp r1, r2\n    bne L%d\n    add #%d, r1\n", i, i, i);
+    }
+    fprintf(file, "    jsr EXTERNAL\n    stop\n");
+    fprintf(file, "NUMS: .data 1, -2, 3, 400\nTEXT: .string \"serve\"\n");
+
+    fclose(file);
+    return 0;
+}
+
+/* run the assembler with the given arguments and wait for it; exit status */
+static int run_assembler(char *const argv[])
+{
+    pid_t pid = fork();
+    int status;
+
+    if (pid < 0)
+        return -1;
+    if (pid == 0)
+    {
+        execv(ASSEMBLER, argv);
+        _exit(127);
+    }
+    if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status))
+        return -1;
+    return WEXITSTATUS(status);
+}
+
+/* time REQUESTS runs of argv; requests per second, or 0 on failure */
+static double time_processes(char *const argv[])
+{
+    double start = now();
+    int i;
+
+    for (i = 0; i < REQUESTS; i++)
+    {
+        if (run_assembler(argv) != 0)
+            return 0;
+    }
+    return REQUESTS / (now() - start);
+}
+
+/* time REQUESTS request frames over one connection; requests per second */
+static double time_socket(const TextBuffer *source)
+{
+    TextBuffer request;
+    TextBuffer response;
+    double start;
+    double rate = 0;
+    int fd = connect_to_server(SOCKET_PATH);
+    int i;
+
+    if (fd < 0)
+        return 0;
+
+    init_text_buffer(&request);
+    init_text_buffer(&response);
+    log_level = LOG_QUIET;
+    if (build_request(&request, SERVE_REQUEST_SOURCE, 0, INPUT_NAME, source->data, source->length, 0))
+    {
+        start = now();
+        for (i = 0; i < REQUESTS; i++)
+        {
+            if (!send_frame(fd, request.data, request.length) || !receive_frame(fd, &response) ||
+                response.data[0] != 1)
+                break;
+        }
+        if (i == REQUESTS)
+            rate = REQUESTS / (now() - start);
+    }
+
+    close(fd);
+    free_text_buffer(&request);
+    free_text_buffer(&response);
+    return rate;
+}
+
+/* start the daemon and wait until it accepts connections */
+static pid_t start_server(void)
+{
+    struct timespec delay;
+    pid_t pid = fork();
+    int tries;
+
+    if (pid < 0)
+        return -1;
+    if (pid == 0)
+    {
+        execl(ASSEMBLER, ASSEMBLER, "-q", "--serve", SOCKET_PATH, (char *)NULL);
+        _exit(127);
+    }
+
+    delay.tv_sec = 0;
+    delay.tv_nsec = 10000000L;
+    for (tries = 0; tries < 200; tries++)
+    {
+        int fd = connect_to_server(SOCKET_PATH);
+        if (fd >= 0)
+        {
+            close(fd);
+            return pid;
+        }
+        nanosleep(&delay, NULL);
+    }
+
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    return -1;
+}
+
+static void report(const char *label, double rate, double baseline)
+{
+    if (rate <= 0)
+        printf("%-10s failed\n", label);
+    else
+        printf("%-10s %8.0f requests/s  %5.1fx\n", label, rate, rate / baseline);
+}
+
+int main(void)
+{
+    char filename[64];
+    char *direct_argv[4];
+    char *client_argv[6];
+    TextBuffer source;
+    double direct_rate, client_rate, socket_rate;
+    pid_t server;
+
+    sprintf(filename, "%s%s", INPUT_NAME, AS_EXTENSION);
+    init_text_buffer(&source);
+    if (write_input(filename) < 0 || !read_file_into_text_buffer(filename, &source))
+    {
+        printf("Cannot write %s\n", filename);
+        return 1;
+    }
+
+    direct_argv[0] = ASSEMBLER;
+    direct_argv[1] = "-q";
+    direct_argv[2] = INPUT_NAME;
+    direct_argv[3] = NULL;
+
+    client_argv[0] = ASSEMBLER;
+    client_argv[1] = "-q";
+    client_argv[2] = "--client";
+    client_argv[3] = SOCKET_PATH;
+    client_argv[4] = INPUT_NAME;
+    client_argv[5] = NULL;
+
+    direct_rate = time_processes(direct_argv);
+    if (direct_rate <= 0)
+    {
+        printf("%s failed on %s\n", ASSEMBLER, filename);
+        return 1;
+    }
+
+    server = start_server();
+    if (server < 0)
+    {
+        printf("Cannot start %s --serve %s\n", ASSEMBLER, SOCKET_PATH);
+        return 1;
+    }
+    client_rate = time_processes(client_argv);
+    socket_rate = time_socket(&source);
+    kill(server, SIGTERM);
+    waitpid(server, NULL, 0);
+
+    printf("%d requests of a %lu byte source:\n", REQUESTS, (unsigned long)source.length);
+    report("fork/exec", direct_rate, direct_rate);
+    report("--client", client_rate, direct_rate);
+    report("socket", socket_rate, direct_rate);
+
+    free_text_buffer(&source);
+    remove(filename);
+    sprintf(filename, "%s%s", INPUT_NAME, OB_EXTENSION);
+    remove(filename);
+    sprintf(filename, "%s%s", INPUT_NAME, ENT_EXTENSION);
+    remove(filename);
+    sprintf(filename, "%s%s", INPUT_NAME, EXT_EXTENSION);
+    remove(filename);
+    return 0;
+}
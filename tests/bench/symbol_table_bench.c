@@ -0,0 +1,123 @@
+/**
+ * @file symbol_table_bench.c
+ * @brief Microbenchmark - hashed symbol table vs. the old linked-list lookup
+ *
+ * Fills the symbol table with N labels and times N successful lookups
+ * plus N misses, once through find_symbol and once through a plain list
+ * walk equivalent to the previous implementation.
+ * Build and run with: make bench-symbols
+ */
+
+#include <time.h>
+#include "../../symbol_table.h"
+#include "../../arena.h"
+
+/* lookups per measurement; the list walk gets fewer at large sizes */
+#define HASH_LOOKUPS 2000000L
+#define LIST_COMPARE_BUDGET 200000000L
+
+static SymbolTable table;
+static Arena arena;
+
+/* previous implementation: walk the list and strcmp every node */
+static Symbol *list_find_symbol(SymbolTable *symbols, const char *name)
+{
+    Symbol *current = symbols->head;
+    while (current)
+    {
+        if (strcmp(current->name, name) == 0)
+            return current;
+        current = current->next;
+    }
+    return NULL;
+}
+
+static void make_name(char *buffer, const char *prefix, int index)
+{
+    sprintf(buffer, "%s%d", prefix, index);
+}
+
+/* hit and miss names, generated up front so only the lookup is timed */
+static char (*hit_names)[MAX_LABEL_LENGTH];
+static char (*miss_names)[MAX_LABEL_LENGTH];
+
+/* time the given number of lookups, alternating hits and misses; returns seconds */
+static double time_lookups(Symbol *(*lookup)(SymbolTable *, const char *), int count, long lookups, long *found)
+{
+    clock_t start = clock();
+    long i;
+
+    *found = 0;
+    for (i = 0; i < lookups; i++)
+    {
+        int index = (int)((i / 2) % count);
+        if (lookup(&table, (i & 1) ? miss_names[index] : hit_names[index]))
+            (*found)++;
+    }
+
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+static void run_size(int count)
+{
+    long hash_found, list_found;
+    long list_lookups = LIST_COMPARE_BUDGET / count;
+    double hash_time, list_time;
+    int i;
+
+    if (list_lookups > HASH_LOOKUPS)
+        list_lookups = HASH_LOOKUPS;
+    list_lookups &= ~1L; /* keep hits and misses balanced */
+
+    hit_names = malloc(count * sizeof(*hit_names));
+    miss_names = malloc(count * sizeof(*miss_names));
+    if (!hit_names || !miss_names)
+    {
+        printf("Memory allocation failed for %d names\n", count);
+        exit(1);
+    }
+
+    release_symbol_table(&table);
+    arena_release(&arena);
+    reserve_symbol_table(&table, count);
+    for (i = 0; i < count; i++)
+    {
+        make_name(hit_names[i], "LBL", i);
+        make_name(miss_names[i], "MISS", i);
+        add_symbol(&table, hit_names[i], BASE_ADDRESS + i, CODE);
+    }
+
+    hash_time = time_lookups(find_symbol, count, HASH_LOOKUPS, &hash_found);
+    list_time = time_lookups(list_find_symbol, count, list_lookups, &list_found);
+
+    /* every label must resolve to its own address, every miss to nothing */
+    for (i = 0; i < count; i++)
+    {
+        Symbol *symbol = find_symbol(&table, hit_names[i]);
+        if (!symbol || symbol->address != BASE_ADDRESS + i || find_symbol(&table, miss_names[i]))
+        {
+            printf("MISMATCH at %d symbols, index %d\n", count, i);
+            break;
+        }
+    }
+
+    hash_time = hash_time * 1e9 / HASH_LOOKUPS;
+    list_time = list_time * 1e9 / list_lookups;
+    printf("%7d symbols: hash %8.1f ns/lookup, list %10.1f ns/lookup, speedup %8.1fx\n",
+           count, hash_time, list_time, hash_time > 0 ? list_time / hash_time : 0.0);
+
+    free(hit_names);
+    free(miss_names);
+}
+
+int main(void)
+{
+    arena_init(&arena);
+    init_symbol_table(&table, &arena);
+    run_size(10);
+    run_size(1000);
+    run_size(100000);
+    release_symbol_table(&table);
+    arena_release(&arena);
+    return 0;
+}
@@ -0,0 +1,389 @@
+/**
+ * @file throughput_bench.c
+ * @brief Lines per second, per-phase time and peak RSS over a generated corpus
+ *
+ * Two measurements over the corpus written by corpus_gen, each the best of
+ * --runs runs:
+ *   end to end    ./assembler -q <every file>, one process; gives lines/s
+ *                 and the peak RSS of that process
+ *   per phase     the phases of asm.c called in this process on sources
+ *                 already in memory, timed one by one
+ * The results are compared with a baseline JSON file; a throughput or
+ * phase time more than BENCH_TIME_TOLERANCE percent worse, or a peak RSS
+ * more than BENCH_RSS_TOLERANCE percent larger, is reported as a
+ * regression and the exit status is 1. --write-baseline stores the
+ * results instead.
+ * Build and run with: make bench (make bench-baseline to store)
+ */
+
+/* for fork, waitpid, getrusage and clock_gettime under -ansi */
+#define _POSIX_C_SOURCE 200112L
+
+#include "../../preassembler.h"
+#include "../../first_pass.h"
+#include "../../second_pass.h"
+#include "../../memory_builder.h"
+#include "../../output_writer.h"
+#include "../../line_parser.h"
+#include "../../text_buffer.h"
+#include "../../context.h"
+#include "../../console.h"
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define ASSEMBLER "./assembler"
+#define DEFAULT_RUNS 5
+#define BENCH_TIME_TOLERANCE 20 /* percent; phase times of a few ms are noisy */
+#define BENCH_RSS_TOLERANCE 10  /* percent */
+#define PATH_SIZE 512
+
+enum
+{
+    PHASE_PREASSEMBLER,
+    PHASE_FIRST_PASS,
+    PHASE_MEMORY_IMAGE,
+    PHASE_SECOND_PASS,
+    PHASE_OUTPUT,
+    PHASE_COUNT
+};
+
+static const char *const phase_names[PHASE_COUNT] = {
+    "preassembler", "first_pass", "memory_image", "second_pass", "output"};
+
+typedef struct
+{
+    int files;
+    long lines;
+    double lines_per_second;
+    long peak_rss_kb;
+    double phase_ms[PHASE_COUNT];
+} BenchResults;
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* "files N\nlines M\n" as written by corpus_gen */
+static int read_manifest(const char *dir, BenchResults *results)
+{
+    char path[PATH_SIZE];
+    FILE *file;
+    int ok;
+
+    sprintf(path, "%s/manifest", dir);
+    file = fopen(path, "r");
+    if (!file)
+        return 0;
+    ok = fscanf(file, "files %d lines %ld", &results->files, &results->lines) == 2;
+    fclose(file);
+    return ok && results->files > 0 && results->lines > 0;
+}
+
+/* one process over every file of the corpus; wall time, or -1 */
+static double time_assembler(char *const argv[])
+{
+    double start = now();
+    pid_t pid = fork();
+    int status;
+
+    if (pid < 0)
+        return -1;
+    if (pid == 0)
+    {
+        execv(ASSEMBLER, argv);
+        _exit(127);
+    }
+    if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        return -1;
+    return now() - start;
+}
+
+/* every phase of asm.c on one source, adding the time of each to elapsed */
+static int time_phases(AssemblerContext *ctx, const char *name, const TextBuffer *source,
+                       double elapsed[PHASE_COUNT])
+{
+    TextBuffer expanded, object, entries, externals;
+    ParsedProgram program;
+    double start;
+    int ok;
+
+    init_text_buffer(&expanded);
+    init_text_buffer(&object);
+    init_text_buffer(&entries);
+    init_text_buffer(&externals);
+    init_parsed_program(&program);
+
+    start = now();
+    ok = preassembler(ctx, source, &expanded);
+    elapsed[PHASE_PREASSEMBLER] += now() - start;
+
+    if (ok)
+    {
+        start = now();
+        ok = first_pass(ctx, &expanded, &program);
+        elapsed[PHASE_FIRST_PASS] += now() - start;
+    }
+    if (ok)
+    {
+        start = now();
+        ok = build_memory_image(ctx, &program);
+        elapsed[PHASE_MEMORY_IMAGE] += now() - start;
+    }
+    if (ok)
+    {
+        start = now();
+        ok = second_pass(ctx, name, &program);
+        elapsed[PHASE_SECOND_PASS] += now() - start;
+    }
+    if (ok)
+    {
+        start = now();
+        ok = format_object_file(ctx, &object) && format_entries_file(ctx, &entries) &&
+             format_externals_file(ctx, &externals);
+        elapsed[PHASE_OUTPUT] += now() - start;
+    }
+
+    free_parsed_program(&program);
+    free_text_buffer(&expanded);
+    free_text_buffer(&object);
+    free_text_buffer(&entries);
+    free_text_buffer(&externals);
+    reset_assembler_context(ctx);
+    return ok;
+}
+
+/* value of "key": in a flat JSON text, or -1 when it is missing */
+static double json_number(const char *json, const char *key)
+{
+    char pattern[64];
+    const char *found;
+
+    sprintf(pattern, "\"%s\":", key);
+    found = strstr(json, pattern);
+    return found ? strtod(found + strlen(pattern), NULL) : -1;
+}
+
+static int write_baseline(const char *path, const BenchResults *results)
+{
+    FILE *file = fopen(path, "w");
+    int i;
+
+    if (!file)
+        return 0;
+    fprintf(file, "{\n  \"files\": %d,\n  \"lines\": %ld,\n", results->files, results->lines);
+    fprintf(file, "  \"lines_per_second\": %.0f,\n", results->lines_per_second);
+    fprintf(file, "  \"peak_rss_kb\": %ld,\n  \"phase_ms\": {\n", results->peak_rss_kb);
+    for (i = 0; i < PHASE_COUNT; i++)
+    {
+        fprintf(file, "    \"%s\": %.3f%s\n", phase_names[i], results->phase_ms[i],
+                i + 1 < PHASE_COUNT ? "," : "");
+    }
+    fprintf(file, "  }\n}\n");
+    fclose(file);
+    return 1;
+}
+
+/* print one comparison; 1 when it is a regression */
+static int compare(const char *label, double value, double baseline, int higher_is_better,
+                   int tolerance)
+{
+    double change;
+    int regression;
+
+    if (baseline <= 0)
+    {
+        printf("  %-18s %12.3f  (no baseline)\n", label, value);
+        return 0;
+    }
+    change = (value - baseline) * 100.0 / baseline;
+    regression = higher_is_better ? change < -tolerance : change > tolerance;
+    printf("  %-18s %12.3f  baseline %12.3f  %+6.1f%%%s\n", label, value, baseline, change,
+           regression ? "  REGRESSION" : "");
+    return regression;
+}
+
+static int compare_with_baseline(const char *path, const BenchResults *results)
+{
+    TextBuffer json;
+    int regressions = 0;
+    int i;
+
+    init_text_buffer(&json);
+    if (!read_file_into_text_buffer(path, &json) || !append_to_text_buffer(&json, "", 0))
+    {
+        printf("No baseline at %s (make bench-baseline stores one)\n", path);
+        free_text_buffer(&json);
+        return 0;
+    }
+
+    printf("Compared with %s:\n", path);
+    regressions += compare("lines/s", results->lines_per_second,
+                           json_number(json.data, "lines_per_second"), 1, BENCH_TIME_TOLERANCE);
+    regressions += compare("peak RSS (KB)", (double)results->peak_rss_kb,
+                           json_number(json.data, "peak_rss_kb"), 0, BENCH_RSS_TOLERANCE);
+
+    /* phase times are totals, so they only compare on the same corpus */
+    if (json_number(json.data, "lines") != (double)results->lines)
+        printf("  (baseline corpus differs; phase times not compared)\n");
+    else
+    {
+        for (i = 0; i < PHASE_COUNT; i++)
+        {
+            regressions += compare(phase_names[i], results->phase_ms[i],
+                                   json_number(json.data, phase_names[i]), 0, BENCH_TIME_TOLERANCE);
+        }
+    }
+
+    free_text_buffer(&json);
+    return regressions;
+}
+
+int main(int argc, char *argv[])
+{
+    BenchResults results;
+    TextBuffer *sources;
+    char **names;
+    char **assembler_argv;
+    AssemblerContext context;
+    struct rusage usage;
+    double best_wall = -1;
+    double best_phase[PHASE_COUNT];
+    int write = 0;
+    int runs = DEFAULT_RUNS;
+    int run, i;
+    int regressions;
+
+    for (i = 3; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--write-baseline") == 0)
+            write = 1;
+        else if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0)
+            runs = atoi(argv[++i]);
+        else
+            break;
+    }
+    memset(&results, 0, sizeof(results));
+    if (argc < 3 || i < argc || strlen(argv[1]) > PATH_SIZE - 32)
+    {
+        printf("Usage: %s CORPUS_DIR BASELINE.json [--runs N] [--write-baseline]\n", argv[0]);
+        return 1;
+    }
+    if (!read_manifest(argv[1], &results))
+    {
+        printf("Cannot read %s/manifest (run corpus_gen first)\n", argv[1]);
+        return 1;
+    }
+
+    /* file names without .as, as the assembler takes them, and their sources */
+    sources = malloc(results.files * sizeof(TextBuffer));
+    names = malloc(results.files * sizeof(char *));
+    assembler_argv = malloc((results.files + 3) * sizeof(char *));
+    if (!sources || !names || !assembler_argv)
+    {
+        printf("Out of memory\n");
+        return 1;
+    }
+    assembler_argv[0] = ASSEMBLER;
+    assembler_argv[1] = "-q";
+    for (i = 0; i < results.files; i++)
+    {
+        char path[PATH_SIZE];
+
+        names[i] = malloc(PATH_SIZE);
+        init_text_buffer(&sources[i]);
+        if (!names[i])
+        {
+            printf("Out of memory\n");
+            return 1;
+        }
+        sprintf(names[i], "%s/prog_%04d", argv[1], i);
+        sprintf(path, "%s%s", names[i], AS_EXTENSION);
+        if (!read_file_into_text_buffer(path, &sources[i]))
+        {
+            printf("Cannot read %s\n", path);
+            return 1;
+        }
+        assembler_argv[i + 2] = names[i];
+    }
+    assembler_argv[results.files + 2] = NULL;
+
+    /* end to end */
+    for (run = 0; run < runs; run++)
+    {
+        double wall = time_assembler(assembler_argv);
+
+        if (wall < 0)
+        {
+            printf("%s failed on the corpus in %s\n", ASSEMBLER, argv[1]);
+            return 1;
+        }
+        if (best_wall < 0 || wall < best_wall)
+            best_wall = wall;
+    }
+    getrusage(RUSAGE_CHILDREN, &usage);
+    results.lines_per_second = results.lines / best_wall;
+    results.peak_rss_kb = usage.ru_maxrss;
+
+    /* per phase, in this process */
+    log_level = LOG_QUIET;
+    init_assembler_context(&context);
+    for (run = 0; run < runs; run++)
+    {
+        double elapsed[PHASE_COUNT];
+
+        memset(elapsed, 0, sizeof(elapsed));
+        for (i = 0; i < results.files; i++)
+        {
+            if (!time_phases(&context, names[i], &sources[i], elapsed))
+            {
+                printf("Assembling %s failed\n", names[i]);
+                return 1;
+            }
+        }
+        for (i = 0; i < PHASE_COUNT; i++)
+        {
+            if (run == 0 || elapsed[i] < best_phase[i])
+                best_phase[i] = elapsed[i];
+        }
+    }
+    free_assembler_context(&context);
+    for (i = 0; i < PHASE_COUNT; i++)
+        results.phase_ms[i] = best_phase[i] * 1000.0;
+
+    printf("Corpus %s: %d files, %ld lines, best of %d runs\n", argv[1], results.files,
+           results.lines, runs);
+    printf("  end to end   %8.3f s  %10.0f lines/s  peak RSS %ld KB\n", best_wall,
+           results.lines_per_second, results.peak_rss_kb);
+    for (i = 0; i < PHASE_COUNT; i++)
+        printf("  %-12s %8.3f ms\n", phase_names[i], results.phase_ms[i]);
+
+    if (write)
+    {
+        if (!write_baseline(argv[2], &results))
+        {
+            printf("Cannot write %s\n", argv[2]);
+            return 1;
+        }
+        printf("Baseline written to %s\n", argv[2]);
+        regressions = 0;
+    }
+    else
+        regressions = compare_with_baseline(argv[2], &results);
+
+    for (i = 0; i < results.files; i++)
+    {
+        free(names[i]);
+        free_text_buffer(&sources[i]);
+    }
+    free(names);
+    free(sources);
+    free(assembler_argv);
+    return regressions > 0;
+}
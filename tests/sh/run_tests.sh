@@ -30,7 +30,7 @@ run_test() {
     dir_name=$(dirname "$test_file")
     
     # Run the assembler
-    ./assembler "$dir_name/$base_name" > test_output.log 2>&1
+    ./assembler --keep-am "$dir_name/$base_name" > test_output.log 2>&1
     result=$?
     
     if [ "$expected_result" = "pass" ]; then
@@ -105,6 +105,161 @@ TOTAL_TESTS=$((TOTAL_TESTS + 1))
 echo
 rm -f test_output.log
 
+# The tests below run in a scratch directory with sources of their own
+ASSEMBLER="$(pwd)/assembler"
+WORK_DIR=$(mktemp -d)
+
+# Record a test that checks more than the exit status; failure is empty if it passed
+check_result() {
+    local description=$1
+    local failure=$2
+
+    TOTAL_TESTS=$((TOTAL_TESTS + 1))
+    echo -e "${YELLOW}Test $TOTAL_TESTS:${NC} $description"
+    if [ -z "$failure" ]; then
+        echo -e "${GREEN}✓ PASSED${NC}"
+        PASSED_TESTS=$((PASSED_TESTS + 1))
+    else
+        echo -e "${RED}✗ FAILED${NC} - $failure"
+        FAILED_TESTS=$((FAILED_TESTS + 1))
+    fi
+    echo
+}
+
+# Macros, an entry and an external, so that every output file is written
+write_feature_source() {
+    cat > "$1" << 'EOF'
+mcro twice
+inc r1
+inc r1
+mcroend
+mcro call_ext
+jsr FUNC
+prn #1
+mcroend
+.extern FUNC
+START: twice
+       twice
+       call_ext
+L2:    call_ext
+       mov START, r3
+       stop
+.entry L2
+EOF
+}
+
+echo "Running cache tests..."
+echo "====================="
+
+mkdir -p "$WORK_DIR/cache"
+failure=$(
+    cd "$WORK_DIR/cache" || exit
+    write_feature_source prog.as
+    "$ASSEMBLER" -v --cache-dir entries prog > cold.log 2>&1 || { echo "cold run failed"; exit; }
+    for ext in ob ent ext; do mv "prog.$ext" "cold.$ext"; done
+    "$ASSEMBLER" -v --cache-dir entries prog > warm.log 2>&1 || { echo "warm run failed"; exit; }
+    for ext in ob ent ext; do
+        cmp -s "cold.$ext" "prog.$ext" || { echo ".$ext differs from the cold run"; exit; }
+    done
+    grep -q "^Cache: 1 hits, 0 misses" warm.log || { echo "the warm run reported no cache hit"; exit; }
+    # the same messages, apart from the hit line and the counts
+    grep -v "^Cache" cold.log > cold.messages
+    grep -v "^Cache" warm.log > warm.messages
+    cmp -s cold.messages warm.messages || echo "the warm run printed different messages"
+)
+check_result "Cache: a warm run restores the outputs and the messages" "$failure"
+
+echo "Running macro library tests..."
+echo "============================="
+
+# Overwrite bytes of a file in place: patch_file FILE OFFSET PRINTF-BYTES
+patch_file() {
+    printf "$3" | dd of="$1" bs=1 seek="$2" conv=notrunc 2> /dev/null
+}
+
+mkdir -p "$WORK_DIR/mlib/inline" "$WORK_DIR/mlib/library"
+failure=$(
+    cd "$WORK_DIR/mlib" || exit
+    write_feature_source inline/prog.as
+    # the mcro blocks (first 8 lines) become the library, the rest uses it
+    head -n 8 inline/prog.as > macros.as
+    tail -n +9 inline/prog.as > library/prog.as
+    (cd inline && "$ASSEMBLER" --keep-am prog > run.log 2>&1) || { echo "inline run failed"; exit; }
+    "$ASSEMBLER" --build-macro-lib macros.mlib macros > build.log 2>&1 || { echo "building the library failed"; exit; }
+    (cd library && "$ASSEMBLER" --keep-am --macro-lib ../macros.mlib prog > run.log 2>&1) ||
+        { echo "run with the library failed"; exit; }
+    for ext in am ob ent ext; do
+        cmp -s "inline/prog.$ext" "library/prog.$ext" || { echo ".$ext differs from the inline macros"; exit; }
+    done
+)
+check_result "Macro library: build and use matches inline macros" "$failure"
+
+# Damaged libraries: magic 0-7, macro count 8-11, index capacity 12-15,
+# text length 16-19, then the first record: name offset 20-23, name
+# length 24-27, body offset 28-31, body length 32-35
+check_damaged_library() {
+    local description=$1
+    local offset=$2
+    local bytes=$3  # for truncate: bytes kept, or dropped from the end if negative
+
+    failure=$(
+        cd "$WORK_DIR/mlib" || exit
+        cp macros.mlib damaged.mlib
+        if [ "$offset" = truncate ]; then
+            head -c "$bytes" macros.mlib > damaged.mlib
+        else
+            patch_file damaged.mlib "$offset" "$bytes"
+        fi
+        (cd library && "$ASSEMBLER" --macro-lib ../damaged.mlib prog > damaged.log 2>&1)
+        status=$?
+        [ $status -eq 1 ] || { echo "exit status $status, expected 1"; exit; }
+        grep -q "^Error" library/damaged.log || echo "no error message"
+    )
+    check_result "Macro library: $description is rejected" "$failure"
+}
+
+check_damaged_library "a library cut inside the header" truncate 12
+check_damaged_library "a library cut inside the records" truncate 60
+check_damaged_library "a library cut inside the text" truncate -3
+check_damaged_library "a file with the wrong magic" 0 'NOTALIB!'
+check_damaged_library "a huge macro count" 8 '\377\377\377\377'
+check_damaged_library "an index capacity that is not a power of two" 12 '\000\000\000\003'
+check_damaged_library "a text length past the end" 16 '\000\001\000\000'
+check_damaged_library "a name offset past the text" 20 '\000\377\377\377'
+check_damaged_library "a body length past the text" 32 '\177\377\377\377'
+
+echo "Running pipe mode tests..."
+echo "========================="
+
+mkdir -p "$WORK_DIR/pipe"
+failure=$(
+    cd "$WORK_DIR/pipe" || exit
+    write_feature_source prog.as
+    "$ASSEMBLER" prog > file.log 2>&1 || { echo "file run failed"; exit; }
+
+    # the object goes to stdout by default
+    "$ASSEMBLER" - < prog.as > stdout.ob 2> pipe.log || { echo "- failed"; exit; }
+    cmp -s prog.ob stdout.ob || { echo "the object on stdout differs"; exit; }
+
+    "$ASSEMBLER" --stdin --ob-fd 5 --ent-fd 3 --ext-fd 4 < prog.as 5> fd.ob 3> fd.ent 4> fd.ext > pipe.log 2>&1 ||
+        { echo "--stdin with --ob-fd/--ent-fd/--ext-fd failed"; exit; }
+    for ext in ob ent ext; do
+        cmp -s "prog.$ext" "fd.$ext" || { echo "the .$ext written to a descriptor differs"; exit; }
+    done
+)
+check_result "Pipe mode: outputs on descriptors match a file run" "$failure"
+
+failure=$(
+    cd "$WORK_DIR/pipe" || exit
+    "$ASSEMBLER" - --ob-fd 9 < prog.as 9>&- > closed.log 2>&1
+    status=$?
+    [ $status -ne 0 ] || { echo "exit status 0 with a closed --ob-fd"; exit; }
+    grep -q "^Error: Cannot write object to file descriptor 9" closed.log || echo "no error message"
+)
+check_result "Pipe mode: a closed --ob-fd is an error" "$failure"
+
+rm -rf "$WORK_DIR"
+
 # Summary
 echo "===================="
 echo "Test Summary:"
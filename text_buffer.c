@@ -0,0 +1,291 @@
+/**
+ * @file text_buffer.c
+ * @brief Growable in-memory text buffer
+ *
+ * The pre-assembler writes the macro-expanded program into a TextBuffer
+ * and the first pass reads it back line by line, so the expanded source
+ * does not have to go through a file on disk.
+ *
+ * Input files, and stdin in pipe mode, are read whole, once: mapped when
+ * they are regular files, read with read() otherwise. Phases walk the
+ * text as line spans and copy a line only once it is known to fit their
+ * line buffer.
+ */
+
+/* for open/read/write, fstat and mmap under -ansi */
+#define _POSIX_C_SOURCE 200112L
+
+#include "text_buffer.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+/* initial buffer size in bytes */
+#define TEXT_BUFFER_INITIAL_CAPACITY 4096
+
+/* most bytes asked of a single read() from a pipe */
+#define TEXT_BUFFER_READ_SIZE 65536
+
+/* Prepare an empty buffer */
+void init_text_buffer(TextBuffer *buffer)
+{
+    buffer->data = NULL;
+    buffer->length = 0;
+    buffer->capacity = 0;
+}
+
+/* Make room for length more bytes and the terminating NUL */
+static Boolean grow_text_buffer(TextBuffer *buffer, size_t length)
+{
+    if (buffer->length + length + 1 > buffer->capacity)
+    {
+        size_t new_capacity = buffer->capacity ? buffer->capacity : TEXT_BUFFER_INITIAL_CAPACITY;
+        char *new_data;
+
+        while (buffer->length + length + 1 > new_capacity)
+        {
+            new_capacity *= 2;
+        }
+
+        new_data = realloc(buffer->data, new_capacity);
+        if (!new_data)
+        {
+            return FALSE;
+        }
+        buffer->data = new_data;
+        buffer->capacity = new_capacity;
+    }
+    return TRUE;
+}
+
+/* Append length bytes of text; the buffer stays NUL terminated */
+Boolean append_to_text_buffer(TextBuffer *buffer, const char *text, size_t length)
+{
+    if (!grow_text_buffer(buffer, length))
+    {
+        return FALSE;
+    }
+
+    memcpy(buffer->data + buffer->length, text, length);
+    buffer->length += length;
+    buffer->data[buffer->length] = '\0';
+    return TRUE;
+}
+
+/* Release the buffer contents */
+void free_text_buffer(TextBuffer *buffer)
+{
+    free(buffer->data);
+    init_text_buffer(buffer);
+}
+
+/**
+ * @brief Find the next line of the buffer
+ * @param buffer Buffer to read from
+ * @param position Read offset, advanced past the line and its newline
+ * @param line Set to the line, which stays inside the buffer
+ * @return FALSE at the end of the buffer
+ */
+Boolean next_line_span(const TextBuffer *buffer, size_t *position, LineSpan *line)
+{
+    const char *start = buffer->data + *position;
+    const char *newline;
+
+    if (*position >= buffer->length)
+    {
+        return FALSE;
+    }
+
+    newline = memchr(start, '\n', buffer->length - *position);
+    line->text = start;
+    line->newline = newline ? TRUE : FALSE;
+    line->length = newline ? (size_t)(newline - start) : buffer->length - *position;
+    *position += line->length + (newline ? 1 : 0);
+    return TRUE;
+}
+
+/* Shorten a line to what fgets would put in a buffer of size bytes;
+   the rest of it becomes the next line */
+void split_line_span(const TextBuffer *buffer, size_t *position, LineSpan *line, size_t size)
+{
+    if (line->length + 2 <= size)
+    {
+        return;
+    }
+    line->length = size - 1;
+    line->newline = FALSE;
+    *position = (size_t)(line->text - buffer->data) + line->length;
+}
+
+/* Copy a line into a NUL terminated buffer, with its newline as fgets
+   would keep it; the caller has checked that it fits */
+void copy_line_span(const LineSpan *line, char *destination)
+{
+    memcpy(destination, line->text, line->length);
+    if (line->newline)
+    {
+        destination[line->length] = '\n';
+        destination[line->length + 1] = '\0';
+    }
+    else
+    {
+        destination[line->length] = '\0';
+    }
+}
+
+/* Read everything left in fd into buffer. Each read() goes straight
+   into the free end of the buffer, at most TEXT_BUFFER_READ_SIZE bytes
+   at a time; the buffer only grows once it is full. */
+static Boolean read_all_into_text_buffer(int fd, TextBuffer *buffer)
+{
+    for (;;)
+    {
+        ssize_t count;
+        size_t room;
+
+        if (!grow_text_buffer(buffer, 1))
+        {
+            return FALSE;
+        }
+        room = buffer->capacity - buffer->length - 1;
+        count = read(fd, buffer->data + buffer->length,
+                     room < TEXT_BUFFER_READ_SIZE ? room : TEXT_BUFFER_READ_SIZE);
+        if (count < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return FALSE;
+        }
+        buffer->length += (size_t)count;
+        buffer->data[buffer->length] = '\0';
+        if (count == 0)
+        {
+            return TRUE;
+        }
+    }
+}
+
+/* Read a whole file into an empty buffer; FALSE if it cannot be read */
+Boolean read_file_into_text_buffer(const char *filename, TextBuffer *buffer)
+{
+    int fd = open(filename, O_RDONLY);
+    Boolean success;
+
+    if (fd < 0)
+    {
+        return FALSE;
+    }
+
+    success = read_all_into_text_buffer(fd, buffer);
+    close(fd);
+    return success;
+}
+
+/**
+ * @brief Make everything left in an open file available as a read-only buffer
+ * @param fd File to read, e.g. stdin; not closed
+ * @param buffer Empty buffer; release with release_mapped_text_buffer
+ * @return FALSE if the file cannot be read
+ *
+ * A non-empty regular file read from its start is mapped, so reading it
+ * costs no copy; the mapping is marked by capacity 0 and is not NUL
+ * terminated. Pipes, empty files and files that cannot be mapped are
+ * read with read().
+ */
+Boolean map_fd_into_text_buffer(int fd, TextBuffer *buffer)
+{
+    struct stat info;
+    void *mapping;
+
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0 &&
+        lseek(fd, 0, SEEK_CUR) == 0)
+    {
+        mapping = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED)
+        {
+            buffer->data = (char *)mapping;
+            buffer->length = (size_t)info.st_size;
+            buffer->capacity = 0;
+            return TRUE;
+        }
+    }
+
+    return read_all_into_text_buffer(fd, buffer);
+}
+
+/* The same for a file by name */
+Boolean map_file_into_text_buffer(const char *filename, TextBuffer *buffer)
+{
+    int fd = open(filename, O_RDONLY);
+    Boolean success;
+
+    if (fd < 0)
+    {
+        return FALSE;
+    }
+
+    success = map_fd_into_text_buffer(fd, buffer);
+    close(fd);
+    return success;
+}
+
+/* Release a buffer filled by map_file_into_text_buffer */
+void release_mapped_text_buffer(TextBuffer *buffer)
+{
+    if (buffer->data && buffer->capacity == 0)
+    {
+        munmap(buffer->data, buffer->length);
+        init_text_buffer(buffer);
+    }
+    else
+    {
+        free_text_buffer(buffer);
+    }
+}
+
+/* Write length bytes to an open file, e.g. stdout; not closed */
+Boolean write_text_to_fd(int fd, const char *data, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t written = write(fd, data, length);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return FALSE;
+        }
+        data += written;
+        length -= written;
+    }
+
+    return TRUE;
+}
+
+/* Write length bytes to a new file, with a single write where possible */
+Boolean write_text_to_file(const char *filename, const char *data, size_t length)
+{
+    int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+
+    if (fd < 0)
+    {
+        return FALSE;
+    }
+
+    if (!write_text_to_fd(fd, data, length))
+    {
+        close(fd);
+        return FALSE;
+    }
+
+    return close(fd) == 0 ? TRUE : FALSE;
+}
+
+/* Write the whole buffer to a file */
+Boolean write_text_buffer_to_file(const TextBuffer *buffer, const char *filename)
+{
+    return write_text_to_file(filename, buffer->data, buffer->length);
+}
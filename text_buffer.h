@@ -0,0 +1,34 @@
+/* text_buffer.h - growable in-memory text (macro-expanded source) */
+#ifndef TEXT_BUFFER_H
+#define TEXT_BUFFER_H
+
+#include "assembler.h"
+
+void init_text_buffer(TextBuffer *buffer);
+Boolean append_to_text_buffer(TextBuffer *buffer, const char *text, size_t length);
+void free_text_buffer(TextBuffer *buffer);
+
+/* one line of a buffer, viewed in place */
+typedef struct
+{
+    const char *text; /* start of the line; not NUL terminated */
+    size_t length;    /* bytes before the newline */
+    Boolean newline;  /* FALSE only for a last line without one */
+} LineSpan;
+
+/* line by line reading of the buffer, without copying */
+Boolean next_line_span(const TextBuffer *buffer, size_t *position, LineSpan *line);
+void split_line_span(const TextBuffer *buffer, size_t *position, LineSpan *line, size_t size);
+void copy_line_span(const LineSpan *line, char *destination);
+
+/* whole-file reading and writing; the _fd forms work on open files
+   such as stdin and stdout (pipe mode) */
+Boolean read_file_into_text_buffer(const char *filename, TextBuffer *buffer);
+Boolean map_file_into_text_buffer(const char *filename, TextBuffer *buffer);
+Boolean map_fd_into_text_buffer(int fd, TextBuffer *buffer);
+void release_mapped_text_buffer(TextBuffer *buffer);
+Boolean write_text_to_file(const char *filename, const char *data, size_t length);
+Boolean write_text_to_fd(int fd, const char *data, size_t length);
+Boolean write_text_buffer_to_file(const TextBuffer *buffer, const char *filename);
+
+#endif /* TEXT_BUFFER_H */
@@ -21,6 +21,12 @@
 #define MATRIX_ADDR 2
 #define REGISTER_ADDR 3
 
+/* addressing-mode bitmasks, one bit per addressing type */
+#define MODE_BIT(mode) (1 << (mode))
+#define MODES_NONE 0
+#define MODES_ANY (MODE_BIT(IMMEDIATE_ADDR) | MODE_BIT(DIRECT_ADDR) | MODE_BIT(MATRIX_ADDR) | MODE_BIT(REGISTER_ADDR))
+#define MODES_NOT_IMMEDIATE (MODE_BIT(DIRECT_ADDR) | MODE_BIT(MATRIX_ADDR) | MODE_BIT(REGISTER_ADDR))
+
 /* aliases for backward compatibility */
 typedef enum
 {
@@ -44,6 +50,14 @@ typedef struct
     unsigned int bits : 10;
 } MachineWord;
 
+/* placeholder instruction word that the second pass patches with a symbol address */
+typedef struct
+{
+    int word_index;                     /* index into instruction_image */
+    char symbol_name[MAX_LABEL_LENGTH]; /* referenced symbol */
+    int line_number;                    /* source line, for error messages */
+} Fixup;
+
 /* simple memory structure */
 typedef struct
 {
@@ -54,6 +68,8 @@ typedef struct
     int data_count;
     int ICF; /* added this */
     int DCF; /* added this */
+    Fixup fixups[256]; /* one per direct/matrix placeholder, in address order */
+    int fixup_count;
 } MemoryImage;
 
 /* symbol structure */
@@ -72,6 +88,8 @@ typedef struct
     char name[10];
     int opcode;
     int operands_count;
+    int src_modes; /* allowed source addressing modes (MODE_BIT mask) */
+    int dst_modes; /* allowed destination (or single operand) modes */
 } InstructionDef;
 
 /* external reference */
@@ -90,4 +108,46 @@ typedef struct EntryPoint
     struct EntryPoint *next;
 } EntryPoint;
 
+/* kind of a source statement */
+typedef enum
+{
+    LINE_INSTRUCTION,
+    LINE_DATA,
+    LINE_STRING,
+    LINE_MATRIX,
+    LINE_ENTRY,
+    LINE_EXTERN,
+    LINE_UNKNOWN
+} LineKind;
+
+/* part of ParsedLine.text: offset and length */
+typedef struct
+{
+    int start;
+    int length;
+} TextSpan;
+
+/* a source statement, parsed once by the first pass */
+typedef struct
+{
+    LineKind kind;
+    int line_number;
+    char text[MAX_LINE_LENGTH];   /* source line without the newline */
+    char label[MAX_LABEL_LENGTH]; /* text before ':' if has_label */
+    int has_label;
+    int opcode;                   /* instructions only, -1 otherwise */
+    int operand_count;
+    int operand_kinds[2];         /* IMMEDIATE_ADDR..REGISTER_ADDR */
+    TextSpan operands[2];         /* operands; symbol name for .entry/.extern */
+    int word_count;               /* memory words the statement occupies */
+} ParsedLine;
+
+/* all statements of one source file, in order */
+typedef struct
+{
+    ParsedLine *lines;
+    int count;
+    int capacity;
+} ParsedProgram;
+
 #endif /* TYPES_H */
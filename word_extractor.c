@@ -1,110 +1,93 @@
 #include "preassembler.h"
 
-/* String processing helper functions */
-char* get_first_word(const char *line) {
-    char *word;
-    char *temp_line;
-    char *token;
-    
-    if (!line) {
-        return NULL;
-    }
-    
-    /* Create a copy of the line to work with */
-    temp_line = malloc(strlen(line) + 1);
-    if (!temp_line) {
-        return NULL;
-    }
-    strcpy(temp_line, line);
-    
-    /* Get first token */
-    token = strtok(temp_line, " \t\n\r");
-    if (!token) {
-        free(temp_line);
-        return NULL;
-    }
-    
-    /* Allocate and copy the first word */
-    word = malloc(strlen(token) + 1);
-    if (!word) {
-        free(temp_line);
-        return NULL;
-    }
-    strcpy(word, token);
-    
-    free(temp_line);
-    return word;
+/* word delimiters, as used by the rest of the preassembler */
+#define WORD_DELIMITERS " \t\n\r"
+
+static Boolean is_word_delimiter(char c) {
+    return c != '\0' && strchr(WORD_DELIMITERS, c) != NULL;
 }
 
-char* get_second_word(const char *line) {
-    char *word;
-    char *temp_line;
-    char *token;
-    
-    if (!line) {
-        return NULL;
-    }
-    
-    /* Create a copy of the line to work with */
-    temp_line = malloc(strlen(line) + 1);
-    if (!temp_line) {
-        return NULL;
-    }
-    strcpy(temp_line, line);
-    
-    /* Get first token (skip it) */
-    token = strtok(temp_line, " \t\n\r");
-    if (!token) {
-        free(temp_line);
-        return NULL;
+/* Scan the word starting at or after *pos; returns FALSE at end of line */
+static Boolean next_word(const char *line, int *pos, TextSpan *word) {
+    int i = *pos;
+
+    while (is_word_delimiter(line[i])) {
+        i++;
     }
-    
-    /* Get second token */
-    token = strtok(NULL, " \t\n\r");
-    if (!token) {
-        free(temp_line);
-        return NULL;
+    if (line[i] == '\0') {
+        *pos = i;
+        return FALSE;
     }
-    
-    /* Allocate and copy the second word */
-    word = malloc(strlen(token) + 1);
-    if (!word) {
-        free(temp_line);
-        return NULL;
+
+    word->start = i;
+    while (line[i] && !is_word_delimiter(line[i])) {
+        i++;
     }
-    strcpy(word, token);
-    
-    free(temp_line);
-    return word;
+    word->length = i - word->start;
+    *pos = i;
+    return TRUE;
 }
 
+/*
+ * Split a line into words and find its label, without copying anything.
+ * All spans are offsets into line, which must outlive the tokens.
+ */
+void tokenize_line(const char *line, LineTokens *tokens) {
+    const char *colon;
+    TextSpan word;
+    int pos = 0;
+    int start, end;
 
-/* Check if there's extraneous text after a specific number of words */
-Boolean has_extraneous_text_after_words(const char *line, int expected_words) {
-    char *temp_line;
-    char *token;
-    int word_count;
+    tokens->word_count = 0;
+    while (next_word(line, &pos, &word)) {
+        if (tokens->word_count < MAX_LINE_WORDS) {
+            tokens->words[tokens->word_count] = word;
+        }
+        tokens->word_count++;
+    }
 
-    word_count = 0;
+    /* a label is the text before the first ':', unless the line starts with it */
+    tokens->has_label = FALSE;
+    tokens->label.start = tokens->label.length = 0;
+    tokens->after_label.start = tokens->after_label.length = 0;
 
-        if (!line)
-    {
-        return FALSE;
+    colon = strchr(line, ':');
+    if (!colon) {
+        return;
     }
 
-    temp_line = malloc(strlen(line) + 1);
-    if (!temp_line) {
-        return FALSE;
+    start = 0;
+    while (isspace((unsigned char)line[start])) {
+        start++;
+    }
+    if (line + start == colon) {
+        return;
+    }
+
+    end = colon - line;
+    while (end > start && isspace((unsigned char)line[end - 1])) {
+        end--;
     }
-    strcpy(temp_line, line);
-    
-    /* Count words */
-    token = strtok(temp_line, " \t\n\r");
-    while (token != NULL) {
-        word_count++;
-        token = strtok(NULL, " \t\n\r");
+    tokens->has_label = TRUE;
+    tokens->label.start = start;
+    tokens->label.length = end - start;
+
+    pos = colon - line + 1;
+    while (isspace((unsigned char)line[pos])) {
+        pos++;
     }
-    
-    free(temp_line);
-    return (word_count > expected_words);
+    next_word(line, &pos, &tokens->after_label);
+}
+
+/* Copy a span into a caller supplied buffer of at least MAX_LINE_LENGTH chars */
+char *span_to_string(const char *line, TextSpan span, char *buffer) {
+    memcpy(buffer, line + span.start, span.length);
+    buffer[span.length] = '\0';
+    return buffer;
+}
+
+/* Compare a span with a NUL terminated word */
+Boolean span_equals(const char *line, TextSpan span, const char *word) {
+    return (int)strlen(word) == span.length &&
+           strncmp(line + span.start, word, span.length) == 0;
 }